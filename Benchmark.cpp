@@ -0,0 +1,933 @@
+/**
+ * Benchmarks for the OrgChart, build with `make bench` and run `./bench`.
+ * */
+#include "OrgChart.hpp"
+#include "ChartBuilder.hpp"
+#include "ChartImporter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using ariel::FlatTree;
+using ariel::OrgChart;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	const unsigned int SEED = 5782;
+
+	double seconds_since(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	/**
+	 * @brief The chart layout the benchmarks compare against: one heap allocation per
+	 * 		  node, holding its name and a vector of pointers to its children
+	 * */
+	struct PointerNode {
+		std::string value;
+		std::vector<PointerNode*> children;
+	};
+
+	PointerNode* find_pointer_node(PointerNode* root, const std::string& value) {
+		if (root->value == value) {
+			return root;
+		}
+		for (PointerNode* child: root->children) {
+			PointerNode* found = find_pointer_node(child, value);
+			if (found != nullptr) {
+				return found;
+			}
+		}
+		return nullptr;
+	}
+
+	PointerNode* copy_pointer_tree(const PointerNode* root) {
+		auto* copy = new PointerNode{root->value, {}};
+		copy->children.reserve(root->children.size());
+		for (const PointerNode* child: root->children) {
+			copy->children.push_back(copy_pointer_tree(child));
+		}
+		return copy;
+	}
+
+	void delete_pointer_tree(PointerNode* root) {
+		for (PointerNode* child: root->children) {
+			delete_pointer_tree(child);
+		}
+		delete root;
+	}
+
+	/**
+	 * @brief Estimate the heap bytes of a pointer tree, counting 16 bytes of allocator
+	 * 		  overhead per block
+	 * */
+	size_t pointer_tree_memory(const PointerNode* root) {
+		const size_t block_overhead = 16;
+		const size_t small_string = 15;
+
+		size_t bytes = sizeof(PointerNode) + block_overhead;
+		if (root->value.capacity() > small_string) {
+			bytes += root->value.capacity() + 1 + block_overhead;
+		}
+		if (root->children.capacity() > 0) {
+			bytes += root->children.capacity() * sizeof(PointerNode*) + block_overhead;
+		}
+		for (const PointerNode* child: root->children) {
+			bytes += pointer_tree_memory(child);
+		}
+		return bytes;
+	}
+
+	/**
+	 * @brief Generate the parent of every node of a random chart of the given size,
+	 * 		  every node reports to a uniformly chosen earlier node
+	 * */
+	std::vector<size_t> random_parents(size_t size) {
+		std::mt19937 generator(SEED);
+		std::vector<size_t> parents(size, 0);
+		for (size_t i = 1; i < size; ++i) {
+			parents[i] = std::uniform_int_distribution<size_t>(0, i - 1)(generator);
+		}
+		return parents;
+	}
+
+	std::vector<std::string> employee_names(size_t size) {
+		std::vector<std::string> names;
+		names.reserve(size);
+		for (size_t i = 0; i < size; ++i) {
+			names.push_back("employee_" + std::to_string(i));
+		}
+		return names;
+	}
+
+	/**
+	 * @brief Build a pointer tree directly, without searching for the parents
+	 * */
+	PointerNode* build_pointer_tree(const std::vector<size_t>& parents, const std::vector<std::string>& names) {
+		std::vector<PointerNode*> nodes(parents.size(), nullptr);
+		for (size_t i = 0; i < parents.size(); ++i) {
+			nodes[i] = new PointerNode{names[i], {}};
+			if (i > 0) {
+				nodes[parents[i]]->children.push_back(nodes[i]);
+			}
+		}
+		return nodes[0];
+	}
+
+	OrgChart build_chart(const std::vector<size_t>& parents, const std::vector<std::string>& names) {
+		OrgChart chart;
+		chart.add_root(names[0]);
+		for (size_t i = 1; i < parents.size(); ++i) {
+			chart.add_sub(names[parents[i]], names[i]);
+		}
+		return chart;
+	}
+
+	FlatTree build_flat_tree(const std::vector<size_t>& parents, const std::vector<std::string>& names) {
+		FlatTree tree;
+		tree.add_root(names[0]);
+		for (size_t i = 1; i < parents.size(); ++i) {
+			tree.add_child(static_cast<ariel::NodeId>(parents[i]), names[i]);
+		}
+		return tree;
+	}
+
+	/**
+	 * @brief Load a chart the way add_sub used to, with a full search for every parent
+	 * */
+	double load_with_tree_search(const std::vector<size_t>& parents, const std::vector<std::string>& names) {
+		auto start = Clock::now();
+
+		auto* root = new PointerNode{names[0], {}};
+		for (size_t i = 1; i < parents.size(); ++i) {
+			PointerNode* parent = find_pointer_node(root, names[parents[i]]);
+			parent->children.push_back(new PointerNode{names[i], {}});
+		}
+
+		double elapsed = seconds_since(start);
+		delete_pointer_tree(root);
+		return elapsed;
+	}
+
+	double load_with_add_sub(const std::vector<size_t>& parents, const std::vector<std::string>& names) {
+		auto start = Clock::now();
+		OrgChart chart = build_chart(parents, names);
+		return seconds_since(start);
+	}
+
+	/**
+	 * @brief Generate names with a realistic title distribution: most employees hold
+	 * 		  one of a few dozen titles, with a Zipf-like popularity, and the rest have
+	 * 		  a title of their own
+	 * */
+	std::vector<std::string> title_names(size_t size) {
+		const std::vector<std::string> titles = {
+			"Software Engineer", "Senior Software Engineer", "Analyst", "Senior Analyst", "Engineer",
+			"Customer Support Representative", "Sales Representative", "Account Manager", "Team Lead",
+			"Project Manager", "Product Manager", "QA Engineer", "DevOps Engineer", "Data Scientist",
+			"Business Analyst", "Accountant", "HR Specialist", "Recruiter", "Designer", "Technical Writer",
+			"Staff Engineer", "Principal Engineer", "Engineering Manager", "Director", "Office Manager",
+			"Legal Counsel", "Marketing Specialist", "Financial Analyst", "Security Engineer", "Researcher"};
+		const size_t unique_per_mille = 100;
+		const size_t per_mille = 1000;
+
+		std::vector<double> weights;
+		for (size_t rank = 1; rank <= titles.size(); ++rank) {
+			weights.push_back(1.0 / static_cast<double>(rank));
+		}
+
+		std::mt19937 generator(SEED);
+		std::discrete_distribution<size_t> pick_title(weights.begin(), weights.end());
+		std::vector<std::string> names;
+		names.reserve(size);
+		for (size_t i = 0; i < size; ++i) {
+			if (generator() % per_mille < unique_per_mille) {
+				names.push_back("Head of Special Project " + std::to_string(i));
+			} else {
+				names.push_back(titles[pick_title(generator)]);
+			}
+		}
+		return names;
+	}
+
+	void bench_interning() {
+		const size_t size = 1000000;
+		auto names = title_names(size);
+		FlatTree tree = build_flat_tree(random_parents(size), names);
+
+		const size_t small_string = 15;
+		size_t name_bytes = 0;
+		size_t string_bytes = 0;
+		for (const auto& name: names) {
+			name_bytes += name.size();
+			string_bytes += sizeof(std::string) + (name.size() > small_string ? name.size() + 1 : 0);
+		}
+		size_t concatenated = name_bytes + size * sizeof(std::uint32_t);
+		size_t interned = tree.names().memory_usage() + size * sizeof(ariel::NameId);
+
+		std::printf("== names of %zu nodes, %zu distinct ==\n", size, tree.names().size());
+		std::printf("std::string per node:     %10zu bytes\n", string_bytes);
+		std::printf("concatenated per node:    %10zu bytes\n", concatenated);
+		std::printf("interned:                 %10zu bytes (%zu saved over concatenated)\n", interned,
+			concatenated > interned ? concatenated - interned : 0);
+	}
+
+	/**
+	 * @brief Time a few full traversals of a chart, starting from the begin call
+	 *
+	 * @return The time of the first traversal and the mean time of the rest
+	 * */
+	template <typename Begin, typename End>
+	std::pair<double, double> time_traversals(int passes, Begin begin, End end) {
+		double first = 0;
+		double rest = 0;
+		for (int pass = 0; pass <= passes; ++pass) {
+			auto start = Clock::now();
+			size_t total_length = 0;
+			for (auto iter = begin(); iter != end(); ++iter) {
+				total_length += iter->size();
+			}
+			(pass == 0 ? first : rest) += seconds_since(start);
+			if (total_length == 0) {
+				std::printf("empty traversal\n");
+			}
+		}
+		return {first, rest / passes};
+	}
+
+	void bench_repeated_traversal() {
+		const size_t size = 1000000;
+		const int passes = 5;
+		OrgChart chart = build_chart(random_parents(size), employee_names(size));
+
+		std::printf("== repeated traversals of %zu nodes (first pass, then mean of %d more) ==\n", size, passes);
+		auto times = time_traversals(passes, [&]() { return chart.begin_level_order(); }, [&]() { return chart.end_level_order(); });
+		std::printf("level order:   %8.3f s %8.3f s\n", times.first, times.second);
+		times = time_traversals(passes, [&]() { return chart.begin_reverse_order(); }, [&]() { return chart.reverse_order(); });
+		std::printf("reverse order: %8.3f s %8.3f s\n", times.first, times.second);
+		times = time_traversals(passes, [&]() { return chart.begin_preorder(); }, [&]() { return chart.end_preorder(); });
+		std::printf("preorder:      %8.3f s %8.3f s\n", times.first, times.second);
+	}
+
+	/**
+	 * @brief Every node of a chain reports to the previous one, the deepest chart of its size
+	 * */
+	std::vector<size_t> chain_parents(size_t size) {
+		std::vector<size_t> parents(size, 0);
+		for (size_t i = 1; i < size; ++i) {
+			parents[i] = i - 1;
+		}
+		return parents;
+	}
+
+	void bench_deep_chain() {
+		const size_t size = 10000000;
+		auto names = employee_names(size);
+
+		std::printf("== deep chain of %zu nodes ==\n", size);
+
+		auto start = Clock::now();
+		auto* chart = new OrgChart(build_chart(chain_parents(size), names));
+		double elapsed = seconds_since(start);
+		std::printf("load:          %8.3f s %12.0f nodes/s\n", elapsed, static_cast<double>(size) / elapsed);
+
+		// The copy shares the nodes until it's modified, so time it with its first edit
+		start = Clock::now();
+		auto* copy = new OrgChart(*chart);
+		copy->add_sub(names[size - 1], "New employee");
+		elapsed = seconds_since(start);
+		std::printf("copy and edit: %8.3f s %12.0f nodes/s\n", elapsed, static_cast<double>(size) / elapsed);
+
+		auto times = time_traversals(1, [&]() { return copy->begin_preorder(); }, [&]() { return copy->end_preorder(); });
+		std::printf("preorder:      %8.3f s %8.3f s\n", times.first, times.second);
+		times = time_traversals(1, [&]() { return copy->begin_reverse_order(); }, [&]() { return copy->reverse_order(); });
+		std::printf("reverse order: %8.3f s %8.3f s\n", times.first, times.second);
+
+		start = Clock::now();
+		delete copy;
+		elapsed = seconds_since(start);
+		std::printf("destroy:       %8.3f s %12.0f nodes/s\n", elapsed, static_cast<double>(size) / elapsed);
+		delete chart;
+	}
+
+	void bench_versions() {
+		const size_t size = 1000000;
+		const size_t lookups = 1000;
+		OrgChart chart = build_chart(random_parents(size), employee_names(size));
+
+		std::printf("== versions of a %zu node chart ==\n", size);
+
+		std::mt19937 generator(SEED);
+		std::vector<OrgChart> versions;
+		versions.reserve(lookups);
+		auto start = Clock::now();
+		for (size_t i = 0; i < lookups; ++i) {
+			versions.push_back(chart.at_version(std::uniform_int_distribution<size_t>(0, chart.version())(generator)));
+		}
+		std::printf("at_version:          %8.3f us per version\n", seconds_since(start) * 1e6 / lookups);
+
+		start = Clock::now();
+		for (size_t i = 0; i < lookups; ++i) {
+			chart.add_sub("employee_0", "New employee " + std::to_string(i));
+		}
+		std::printf("add_sub with versions: %6.3f us per edit\n", seconds_since(start) * 1e6 / lookups);
+
+		OrgChart half = chart.at_version(chart.version() / 2);
+		auto times = time_traversals(1, [&]() { return half.begin_level_order(); }, [&]() { return half.end_level_order(); });
+		std::printf("level order of version %zu: %8.3f s %8.3f s\n", half.version(), times.first, times.second);
+	}
+
+	ariel::ChartBuilder fill_builder(const std::vector<size_t>& parents, const std::vector<std::string>& names,
+		const std::vector<size_t>& edge_order) {
+		ariel::ChartBuilder builder;
+		builder.add_root(names[0]);
+		for (size_t i: edge_order) {
+			builder.add_sub(names[parents[i]], names[i]);
+		}
+		return builder;
+	}
+
+	OrgChart build_with_builder(const std::vector<size_t>& parents, const std::vector<std::string>& names,
+		const std::vector<size_t>& edge_order) {
+		return fill_builder(parents, names, edge_order).build();
+	}
+
+	void bench_parallel_builder() {
+		const size_t size = 10000000;
+		const std::vector<unsigned> thread_counts = {1, 2, 4, 8, 16, 32};
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+		std::vector<size_t> edge_order;
+		for (size_t i = 1; i < size; ++i) {
+			edge_order.push_back(i);
+		}
+		std::shuffle(edge_order.begin(), edge_order.end(), std::mt19937(SEED));
+		ariel::ChartBuilder builder = fill_builder(parents, names, edge_order);
+
+		std::printf("== build of %zu shuffled nodes by threads (%u hardware threads) ==\n", size,
+			std::thread::hardware_concurrency());
+		double single = 0;
+		for (unsigned threads: thread_counts) {
+			auto start = Clock::now();
+			OrgChart chart = builder.build(threads);
+			double elapsed = seconds_since(start);
+			single = threads == 1 ? elapsed : single;
+			std::printf("%2u threads %8.3f s, %5.2f times the time on 1 thread\n", threads, elapsed, elapsed / single);
+		}
+	}
+
+	void bench_builder() {
+		const std::vector<size_t> sizes = {100000, 1000000, 10000000};
+
+		std::printf("== load: add_sub against the builder, then a level order pass over the result ==\n");
+		for (size_t size: sizes) {
+			auto parents = random_parents(size);
+			auto names = employee_names(size);
+			std::vector<size_t> edge_order;
+			for (size_t i = 1; i < size; ++i) {
+				edge_order.push_back(i);
+			}
+
+			auto start = Clock::now();
+			OrgChart chart = build_chart(parents, names);
+			double load = seconds_since(start);
+			auto times = time_traversals(1, [&]() { return chart.begin_level_order(); }, [&]() { return chart.end_level_order(); });
+			std::printf("%10zu nodes add_sub:          load %8.3f s level order %8.3f s\n", size, load, times.first);
+
+			std::shuffle(edge_order.begin(), edge_order.end(), std::mt19937(SEED));
+			start = Clock::now();
+			chart = build_with_builder(parents, names, edge_order);
+			load = seconds_since(start);
+			times = time_traversals(1, [&]() { return chart.begin_level_order(); }, [&]() { return chart.end_level_order(); });
+			std::printf("%10zu nodes builder, shuffled: load %8.3f s level order %8.3f s\n", size, load, times.first);
+		}
+	}
+
+	void bench_deep_copy_and_background_destruction() {
+		const size_t size = 10000000;
+		const std::vector<unsigned> thread_counts = {1, 2, 4, 8};
+		OrgChart chart = build_chart(chain_parents(size), employee_names(size));
+
+		std::printf("== deep copy and destruction of %zu nodes ==\n", size);
+		for (unsigned threads: thread_counts) {
+			auto start = Clock::now();
+			auto* copy = new OrgChart(chart.deep_copy(threads));
+			double copy_elapsed = seconds_since(start);
+			start = Clock::now();
+			delete copy;
+			std::printf("deep copy on %u threads %8.3f s, destroy %8.3f s\n", threads, copy_elapsed, seconds_since(start));
+		}
+
+		OrgChart::destroy_in_background(true);
+		auto* copy = new OrgChart(chart.deep_copy());
+		auto start = Clock::now();
+		delete copy;
+		std::printf("destroy in background  %8.6f s\n", seconds_since(start));
+		OrgChart::destroy_in_background(false);
+	}
+
+	void bench_subtree_traversal() {
+		const size_t size = 1000000;
+		const size_t queries = 1000;
+		auto names = employee_names(size);
+		OrgChart chart = build_chart(random_parents(size), names);
+
+		// The later nodes of a random chart head small subtrees, like most managers
+		std::mt19937 generator(SEED);
+		size_t visited = 0;
+		auto start = Clock::now();
+		for (size_t i = 0; i < queries; ++i) {
+			const std::string& level = names[std::uniform_int_distribution<size_t>(size / 100, size - 1)(generator)];
+			for (auto iter = chart.begin_level_order(level); iter != chart.end_level_order(level); ++iter) {
+				++visited;
+			}
+		}
+		double elapsed = seconds_since(start);
+
+		std::printf("== level order under a level of a %zu node chart ==\n", size);
+		std::printf("under a level: %8.3f us per query (%.1f levels on average)\n", elapsed * 1e6 / queries,
+			static_cast<double>(visited) / queries);
+		start = Clock::now();
+		size_t total_length = 0;
+		for (auto iter = chart.begin_level_order(); iter != chart.end_level_order(); ++iter) {
+			total_length += iter->size();
+		}
+		std::printf("whole chart:   %8.3f us\n", seconds_since(start) * 1e6);
+	}
+
+	void bench_is_under() {
+		const size_t size = 1000000;
+		const size_t queries = 1000000;
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+		OrgChart chart = build_chart(parents, names);
+
+		std::mt19937 generator(SEED);
+		std::vector<std::pair<size_t, size_t>> pairs;
+		for (size_t i = 0; i < queries; ++i) {
+			pairs.emplace_back(std::uniform_int_distribution<size_t>(0, size - 1)(generator),
+				std::uniform_int_distribution<size_t>(0, size / 100)(generator));
+		}
+
+		std::printf("== reporting line checks in a %zu node chart ==\n", size);
+
+		// Before the index, a check meant searching the manager's levels for the other level
+		const size_t searches = 1000;
+		auto start = Clock::now();
+		size_t under = 0;
+		for (size_t i = 0; i < searches; ++i) {
+			auto [level, manager] = pairs[i];
+			auto found = std::find(chart.begin_preorder(names[manager]) + 1, chart.end_preorder(names[manager]), names[level]);
+			under += found != chart.end_preorder(names[manager]) ? 1U : 0U;
+		}
+		std::printf("searching under the manager: %10.3f us per check (%zu under)\n", seconds_since(start) * 1e6 / searches, under);
+
+		start = Clock::now();
+		chart.is_under(names[1], names[0]);
+		std::printf("indexing:                    %10.3f s\n", seconds_since(start));
+		start = Clock::now();
+		under = 0;
+		for (auto [level, manager]: pairs) {
+			under += chart.is_under(names[level], names[manager]) ? 1U : 0U;
+		}
+		std::printf("is_under:                    %10.3f us per check (%zu under)\n", seconds_since(start) * 1e6 / queries, under);
+	}
+
+	/**
+	 * @brief Parents of a deep chart, every level reporting to one of the few levels just before it
+	 * */
+	std::vector<size_t> deep_parents(size_t size, size_t window) {
+		std::mt19937 generator(SEED);
+		std::vector<size_t> parents(size, 0);
+		for (size_t i = 1; i < size; ++i) {
+			parents[i] = i - 1 - std::uniform_int_distribution<size_t>(0, std::min(i, window) - 1)(generator);
+		}
+		return parents;
+	}
+
+	void bench_common_manager(const char* shape, const std::vector<size_t>& parents) {
+		const size_t size = parents.size();
+		const size_t queries = 1000000;
+		auto names = employee_names(size);
+		OrgChart chart = build_chart(parents, names);
+
+		std::vector<size_t> depths(size, 0);
+		std::unordered_map<std::string, size_t> nodes;
+		nodes.reserve(size);
+		for (size_t i = 0; i < size; ++i) {
+			depths[i] = i == 0 ? 0 : depths[parents[i]] + 1;
+			nodes.emplace(names[i], i);
+		}
+		std::mt19937 generator(SEED);
+		std::vector<std::pair<std::string, std::string>> pairs;
+		for (size_t i = 0; i < queries; ++i) {
+			pairs.emplace_back(names[std::uniform_int_distribution<size_t>(0, size - 1)(generator)],
+				names[std::uniform_int_distribution<size_t>(0, size - 1)(generator)]);
+		}
+
+		std::printf("== lowest common managers in a %zu node %s chart (depth %zu) ==\n", size, shape,
+			*std::max_element(depths.begin(), depths.end()));
+
+		// Walking up from both levels until the paths meet, the deeper one first
+		const size_t walks = std::min<size_t>(queries, 1000000000 / size);
+		auto start = Clock::now();
+		size_t checksum = 0;
+		for (size_t i = 0; i < walks; ++i) {
+			size_t first = nodes.find(pairs[i].first)->second;
+			size_t second = nodes.find(pairs[i].second)->second;
+			while (first != second) {
+				if (depths[first] >= depths[second]) {
+					first = parents[first];
+				} else {
+					second = parents[second];
+				}
+			}
+			checksum += names[first].size();
+		}
+		std::printf("walking up:              %10.3f us per pair (%zu)\n", seconds_since(start) * 1e6 / static_cast<double>(walks), checksum);
+
+		start = Clock::now();
+		chart.common_manager(names[1], names[0]);
+		std::printf("indexing:                %10.3f s\n", seconds_since(start));
+		start = Clock::now();
+		checksum = 0;
+		for (size_t i = 0; i < walks; ++i) {
+			checksum += chart.common_manager(pairs[i].first, pairs[i].second).size();
+		}
+		std::printf("common_manager:          %10.3f us per pair (%zu)\n", seconds_since(start) * 1e6 / static_cast<double>(walks), checksum);
+
+		for (unsigned threads: {1U, std::max(2U, std::thread::hardware_concurrency())}) {
+			start = Clock::now();
+			auto managers = chart.common_managers(pairs, threads);
+			std::printf("common_managers %2u thr:  %10.3f us per pair\n", threads, seconds_since(start) * 1e6 / static_cast<double>(queries));
+		}
+	}
+
+	void bench_common_managers() {
+		bench_common_manager("random", random_parents(1000000));
+		bench_common_manager("deep", deep_parents(200000, 8));
+	}
+
+	void bench_headcount() {
+		const size_t size = 1000000;
+		const size_t queries = 1000000;
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+		OrgChart chart = build_chart(parents, names);
+
+		std::mt19937 generator(SEED);
+		std::vector<size_t> levels;
+		for (size_t i = 0; i < queries; ++i) {
+			levels.push_back(std::uniform_int_distribution<size_t>(0, size / 100)(generator));
+		}
+
+		std::printf("== headcounts in a %zu node chart ==\n", size);
+
+		// Before, counting meant listing the levels under the manager
+		const size_t listings = 1000;
+		auto start = Clock::now();
+		size_t total = 0;
+		for (size_t i = 0; i < listings; ++i) {
+			total += chart.preorder(names[levels[i]]).size() - 1;
+		}
+		std::printf("listing the subtree:      %10.3f us per level (%zu)\n", seconds_since(start) * 1e6 / listings, total);
+
+		start = Clock::now();
+		chart.headcount(names[0]);
+		std::printf("first count:              %10.3f s\n", seconds_since(start));
+		start = Clock::now();
+		total = 0;
+		for (size_t level: levels) {
+			total += chart.headcount(names[level]) + chart.depth(names[level]);
+		}
+		std::printf("headcount + depth:        %10.3f us per level (%zu)\n", seconds_since(start) * 1e6 / queries, total);
+
+		// A page view after every edit only counts the new level into its managers
+		const size_t edits = 100000;
+		start = Clock::now();
+		total = 0;
+		for (size_t i = 0; i < edits; ++i) {
+			chart.add_sub(names[levels[i]], "New" + std::to_string(i));
+			total += chart.headcount(names[levels[i]]);
+		}
+		std::printf("add_sub then headcount:   %10.3f us per edit (%zu)\n", seconds_since(start) * 1e6 / edits, total);
+	}
+
+	void bench_write() {
+		const size_t size = 10000000;
+		OrgChart chart = build_chart(random_parents(size), employee_names(size));
+		std::ofstream output("/dev/null");
+
+		std::printf("== writing a %zu node chart ==\n", size);
+
+		// Before, charts were written by a loop over an iterator, a few stream calls per level
+		auto start = Clock::now();
+		for (auto name: chart.preorder()) {
+			output << name << '\n';
+		}
+		output.flush();
+		std::printf("preorder loop:  %8.3f s\n", seconds_since(start));
+
+		for (auto [format, format_name]: {std::pair(ariel::ChartFormat::Indented, "indented"), std::pair(ariel::ChartFormat::Json, "json"),
+				std::pair(ariel::ChartFormat::Dot, "dot")}) {
+			std::ostringstream sample;
+			sample << format << chart;
+			auto bytes = static_cast<double>(sample.str().size());
+			sample = std::ostringstream();
+
+			start = Clock::now();
+			output << format << chart;
+			output.flush();
+			double elapsed = seconds_since(start);
+			std::printf("%-8s        %8.3f s %8.0f MB/s\n", format_name, elapsed, bytes / elapsed / 1e6);
+		}
+	}
+
+	void bench_save_and_load() {
+		const size_t size = 5000000;
+		const std::string text_path = "bench_chart.csv";
+		const std::string binary_path = "bench_chart.orgchart";
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+
+		std::printf("== startup from a %zu node chart file ==\n", size);
+		{
+			std::ofstream text(text_path);
+			text << names[0] << '\n';
+			for (size_t i = 1; i < size; ++i) {
+				text << names[parents[i]] << ',' << names[i] << '\n';
+			}
+		}
+
+		// Before, the chart was rebuilt from its text on every start
+		auto start = Clock::now();
+		OrgChart chart;
+		{
+			std::ifstream text(text_path);
+			std::string line;
+			std::getline(text, line);
+			chart.add_root(line);
+			while (std::getline(text, line)) {
+				size_t comma = line.find(',');
+				chart.add_sub(line.substr(0, comma), line.substr(comma + 1));
+			}
+		}
+		std::printf("rebuild from text: %8.3f s\n", seconds_since(start));
+
+		start = Clock::now();
+		chart.save(binary_path);
+		double elapsed = seconds_since(start);
+		std::ifstream saved(binary_path, std::ios::binary | std::ios::ate);
+		std::printf("save:              %8.3f s %8.1f MB\n", elapsed, static_cast<double>(saved.tellg()) / 1e6);
+
+		start = Clock::now();
+		OrgChart loaded = OrgChart::load(binary_path);
+		std::printf("load:              %8.3f s (%zu levels)\n", seconds_since(start), loaded.size());
+		std::remove(text_path.c_str());
+		std::remove(binary_path.c_str());
+	}
+
+	void bench_map() {
+		const size_t size = 5000000;
+		const std::string path = "bench_chart.orgchart";
+		auto names = employee_names(size);
+		build_chart(random_parents(size), names).save(path);
+
+		std::printf("== opening a saved %zu node chart ==\n", size);
+		auto start = Clock::now();
+		OrgChart loaded = OrgChart::load(path);
+		double load_elapsed = seconds_since(start);
+		start = Clock::now();
+		OrgChart mapped = OrgChart::map(path);
+		double map_elapsed = seconds_since(start);
+		std::printf("open:          load %10.6f s map %10.6f s\n", load_elapsed, map_elapsed);
+
+		start = Clock::now();
+		size_t depth = loaded.depth(names[size / 2]);
+		load_elapsed = seconds_since(start);
+		start = Clock::now();
+		depth += mapped.depth(names[size / 2]);
+		map_elapsed = seconds_since(start);
+		std::printf("first lookup:  load %10.6f s map %10.6f s (%zu)\n", load_elapsed, map_elapsed, depth);
+
+		for (OrgChart* chart: {&loaded, &mapped}) {
+			start = Clock::now();
+			size_t bytes = 0;
+			for (auto name: chart->level_order()) {
+				bytes += name.size();
+			}
+			std::printf("level order:   %s %10.3f s (%zu bytes)\n", chart == &loaded ? "load" : "map ", seconds_since(start), bytes);
+		}
+		std::remove(path.c_str());
+	}
+
+	void bench_import() {
+		const size_t size = 5000000;
+		const std::string path = "bench_chart.csv";
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+		std::vector<size_t> edge_order;
+		for (size_t i = 1; i < size; ++i) {
+			edge_order.push_back(i);
+		}
+		std::shuffle(edge_order.begin(), edge_order.end(), std::mt19937(SEED));
+
+		std::printf("== import of %zu shuffled csv rows ==\n", size);
+		{
+			std::ofstream text(path);
+			text << names[0] << '\n';
+			for (size_t i: edge_order) {
+				text << names[parents[i]] << ',' << names[i] << '\n';
+			}
+		}
+
+		// A line and two strings per row
+		auto start = Clock::now();
+		ariel::ChartBuilder builder;
+		{
+			std::ifstream text(path);
+			std::string line;
+			std::getline(text, line);
+			builder.add_root(line);
+			while (std::getline(text, line)) {
+				size_t comma = line.find(',');
+				builder.add_sub(line.substr(0, comma), line.substr(comma + 1));
+			}
+		}
+		double elapsed = seconds_since(start);
+		std::printf("getline:  read %8.3f s %12.0f rows/s\n", elapsed, static_cast<double>(size) / elapsed);
+
+		ariel::ChartImporter importer;
+		builder = ariel::ChartBuilder();
+		importer.read(path, builder);
+		const ariel::ChartImporter::Stats& stats = importer.stats();
+		std::printf("importer: read %8.3f s %12.0f rows/s %8.0f MB/s\n", stats.seconds, stats.rows_per_second(),
+			static_cast<double>(stats.bytes) / stats.seconds / 1e6);
+		start = Clock::now();
+		OrgChart chart = builder.build();
+		std::printf("          build %7.3f s (%zu levels)\n", seconds_since(start), chart.size());
+		std::remove(path.c_str());
+	}
+
+	void bench_log() {
+		const size_t size = 1000000;
+		const size_t batch = 1000;
+		const std::string path = "bench_logged_chart.orgchart";
+		auto parents = random_parents(size + batch);
+		auto names = employee_names(size + batch);
+		build_chart(std::vector<size_t>(parents.begin(), parents.begin() + size), names).save(path);
+
+		std::printf("== a batch of %zu add_sub calls to a %zu node chart, made durable ==\n", batch, size);
+		// The first add_sub after a load grows the loaded arrays, so it's made before timing
+		OrgChart plain = OrgChart::load(path);
+		plain.add_sub(names[0], "Warm up");
+		auto start = Clock::now();
+		for (size_t i = size; i < size + batch; ++i) {
+			plain.add_sub(names[parents[i]], names[i]);
+		}
+		plain.save(path + ".copy");
+		std::printf("add_sub then save:   %10.6f s\n", seconds_since(start));
+		std::remove((path + ".copy").c_str());
+
+		start = Clock::now();
+		OrgChart chart = OrgChart::open(path);
+		std::printf("open:                %10.6f s\n", seconds_since(start));
+		chart.add_sub(names[0], "Warm up");
+		start = Clock::now();
+		for (size_t i = size; i < size + batch; ++i) {
+			chart.add_sub(names[parents[i]], names[i]);
+		}
+		double elapsed = seconds_since(start);
+		start = Clock::now();
+		chart.sync();
+		std::printf("logged add_sub:      %10.6f s (%.2f us each), sync %10.6f s\n", elapsed,
+			elapsed * 1e6 / static_cast<double>(batch), seconds_since(start));
+
+		start = Clock::now();
+		chart.compact();
+		double foreground = seconds_since(start);
+		chart.add_sub(names[0], "After the compaction");
+		chart = OrgChart();
+		std::printf("compact:             %10.6f s in the foreground, %8.3f s in all\n", foreground, seconds_since(start));
+
+		start = Clock::now();
+		chart = OrgChart::open(path);
+		std::printf("open after compact:  %10.6f s (%zu levels)\n", seconds_since(start), chart.size());
+		chart = OrgChart();
+		for (const std::string& file: {path, path + ".log"}) {
+			std::remove(file.c_str());
+		}
+	}
+
+	void bench_load() {
+		const std::vector<size_t> search_sizes = {2000, 4000, 8000, 16000};
+		const std::vector<size_t> indexed_sizes = {1000, 10000, 100000, 1000000};
+
+		std::printf("== load: tree search per parent (before) ==\n");
+		for (size_t size: search_sizes) {
+			double elapsed = load_with_tree_search(random_parents(size), employee_names(size));
+			std::printf("%10zu nodes %10.3f s %12.0f nodes/s\n", size, elapsed, static_cast<double>(size) / elapsed);
+		}
+
+		std::printf("== load: indexed add_sub (after) ==\n");
+		for (size_t size: indexed_sizes) {
+			double elapsed = load_with_add_sub(random_parents(size), employee_names(size));
+			std::printf("%10zu nodes %10.3f s %12.0f nodes/s\n", size, elapsed, static_cast<double>(size) / elapsed);
+		}
+	}
+
+	void bench_copy_and_destroy() {
+		const size_t size = 1000000;
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+
+		std::printf("== copy and destroy %zu nodes ==\n", size);
+
+		PointerNode* pointer_tree = build_pointer_tree(parents, names);
+		auto start = Clock::now();
+		PointerNode* pointer_copy = copy_pointer_tree(pointer_tree);
+		double copy_elapsed = seconds_since(start);
+		start = Clock::now();
+		delete_pointer_tree(pointer_copy);
+		double destroy_elapsed = seconds_since(start);
+		delete_pointer_tree(pointer_tree);
+		std::printf("node per allocation: copy %8.3f s destroy %8.3f s\n", copy_elapsed, destroy_elapsed);
+
+		OrgChart chart = build_chart(parents, names);
+		start = Clock::now();
+		auto* chart_copy = new OrgChart(chart);
+		copy_elapsed = seconds_since(start);
+		start = Clock::now();
+		chart_copy->add_sub(names[0], "New employee");
+		double first_edit_elapsed = seconds_since(start);
+		start = Clock::now();
+		chart_copy->add_sub(names[0], "Another new employee");
+		double second_edit_elapsed = seconds_since(start);
+		start = Clock::now();
+		delete chart_copy;
+		destroy_elapsed = seconds_since(start);
+		std::printf("chart:               copy %8.6f s destroy %8.3f s\n", copy_elapsed, destroy_elapsed);
+		std::printf("edit of the copy:    first %8.6f s then %8.6f s\n", first_edit_elapsed, second_edit_elapsed);
+
+		// The edited copy shares every chunk it didn't write with the original
+		FlatTree tree = build_flat_tree(parents, names);
+		FlatTree tree_copy = tree;
+		tree_copy.add_child(0, "New employee");
+		std::printf("edited copy holds alone %zu of %zu bytes\n", tree_copy.memory_usage(true), tree.memory_usage());
+	}
+
+	void bench_memory_and_traversal() {
+		const size_t size = 1000000;
+		auto parents = random_parents(size);
+		auto names = employee_names(size);
+
+		std::printf("== memory and level order traversal of %zu nodes ==\n", size);
+
+		PointerNode* pointer_tree = build_pointer_tree(parents, names);
+		size_t bytes = pointer_tree_memory(pointer_tree);
+		delete_pointer_tree(pointer_tree);
+		std::printf("node per allocation: %6.1f bytes/node\n", static_cast<double>(bytes) / static_cast<double>(size));
+
+		FlatTree tree = build_flat_tree(parents, names);
+		std::printf("flat tree:           %6.1f bytes/node\n",
+			static_cast<double>(tree.memory_usage()) / static_cast<double>(size));
+
+		OrgChart chart = build_chart(parents, names);
+		auto start = Clock::now();
+		size_t total_length = 0;
+		for (auto iter = chart.begin_level_order(); iter != chart.end_level_order(); ++iter) {
+			total_length += iter->size();
+		}
+		std::printf("level order:         %8.3f s (%zu name bytes)\n", seconds_since(start), total_length);
+
+		start = Clock::now();
+		auto preorder = chart.begin_preorder();
+		std::printf("preorder first step: %8.6f s\n", seconds_since(start));
+		total_length = 0;
+		for (; preorder != chart.end_preorder(); ++preorder) {
+			total_length += preorder->size();
+		}
+		std::printf("preorder:            %8.3f s (%zu name bytes)\n", seconds_since(start), total_length);
+
+		for (int pass = 1; pass <= 2; ++pass) {
+			start = Clock::now();
+			total_length = 0;
+			for (auto iter = chart.begin_reverse_order(); iter != chart.reverse_order(); ++iter) {
+				total_length += iter->size();
+			}
+			std::printf("reverse order #%d:    %8.3f s (%zu name bytes)\n", pass, seconds_since(start), total_length);
+		}
+	}
+}
+
+int main() {
+	bench_load();
+	bench_builder();
+	bench_parallel_builder();
+	bench_deep_copy_and_background_destruction();
+	bench_subtree_traversal();
+	bench_is_under();
+	bench_common_managers();
+	bench_headcount();
+	bench_write();
+	bench_save_and_load();
+	bench_map();
+	bench_import();
+	bench_log();
+	bench_copy_and_destroy();
+	bench_memory_and_traversal();
+	bench_interning();
+	bench_repeated_traversal();
+	bench_deep_chain();
+	bench_versions();
+	return 0;
+}
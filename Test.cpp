@@ -1,6 +1,22 @@
 #include "doctest.h"
 #include "sources/OrgChart.hpp"
+#include "sources/ChartBuilder.hpp"
+#include "sources/ChartFile.hpp"
+#include "sources/ChartImporter.hpp"
+#include "sources/ChartLog.hpp"
+#include "sources/FlatTree.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 TEST_CASE("add_root_and_subordinate_expect_level_order_correct") {
 	ariel::OrgChart chart;
@@ -81,3 +97,1324 @@ TEST_CASE("add_subordinate_to_non_existent_role_expect_throw") {
 	CHECK_NOTHROW(chart.add_root("CEO"));
 	CHECK_THROWS(chart.add_sub("King", "Manager`"));
 }
+
+TEST_CASE("add_subordinates_to_copied_and_moved_chart_expect_index_follows") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "VP"));
+
+	ariel::OrgChart copy(chart);
+	CHECK_NOTHROW(copy.add_sub("VP", "Programmer"));
+
+	// The copy must not have added anything to the original chart
+	auto iter = chart.begin_level_order();
+	++iter;
+	++iter;
+	CHECK(iter == chart.end_level_order());
+
+	ariel::OrgChart moved(std::move(copy));
+	CHECK_NOTHROW(moved.add_sub("Programmer", "Intern"));
+	CHECK_NOTHROW(moved.add_root("Chairman"));
+	CHECK_NOTHROW(moved.add_sub("Chairman", "CFO"));
+	CHECK_THROWS(moved.add_sub("CEO", "CTO"));
+}
+
+TEST_CASE("add_many_levels_expect_every_order_correct") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "COO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_sub("COO", "VP_BI"));
+	CHECK_NOTHROW(chart.add_sub("VP_SW", "Programmer"));
+
+	std::string level_order;
+	for (auto iter = chart.begin_level_order(); iter != chart.end_level_order(); ++iter) {
+		level_order += std::string(*iter) + " ";
+	}
+	CHECK(level_order == "CEO CTO CFO COO VP_SW VP_BI Programmer ");
+
+	std::string preorder;
+	for (auto iter = chart.begin_preorder(); iter != chart.end_preorder(); ++iter) {
+		preorder += std::string(*iter) + " ";
+	}
+	CHECK(preorder == "CEO CTO VP_SW Programmer CFO COO VP_BI ");
+
+	size_t total_length = 0;
+	for (auto iter = chart.begin_reverse_order(); iter != chart.reverse_order(); ++iter) {
+		total_length += iter->size();
+	}
+	CHECK(total_length == level_order.size() - 7);
+}
+
+TEST_CASE("add_repeated_titles_expect_subordinate_under_first_in_preorder") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(chart.add_sub("CFO", "Analyst"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "Analyst"));
+	// The CFO's Analyst was added first, but the CTO's comes first in preorder
+	CHECK_NOTHROW(chart.add_sub("Analyst", "Intern"));
+
+	std::string preorder;
+	for (auto iter = chart.begin_preorder(); iter != chart.end_preorder(); ++iter) {
+		preorder += std::string(*iter) + " ";
+	}
+	CHECK(preorder == "CEO CTO Analyst Intern CFO Analyst ");
+	CHECK(chart.depth("Intern") == 3);
+}
+
+TEST_CASE("copy_preorder_iterator_mid_iteration_expect_independent_walks") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+
+	auto iter = chart.begin_preorder();
+	++iter;
+	auto copy = iter;
+	++iter;
+	++iter;
+
+	CHECK(*copy == "CTO");
+	CHECK(*iter == "CFO");
+	++copy;
+	CHECK(*copy == "VP_SW");
+	++iter;
+	CHECK(iter == chart.end_preorder());
+}
+
+TEST_CASE("iterate_reverse_order_expect_deepest_level_first_left_to_right") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "COO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_sub("COO", "VP_BI"));
+
+	for (int pass = 0; pass < 2; ++pass) {
+		std::string reverse_order;
+		for (auto iter = chart.begin_reverse_order(); iter != chart.reverse_order(); ++iter) {
+			reverse_order += std::string(*iter) + " ";
+		}
+		CHECK(reverse_order == "VP_SW VP_BI CTO CFO COO CEO ");
+	}
+}
+
+TEST_CASE("iterate_reverse_order_of_wide_chart_expect_every_node_once") {
+	ariel::OrgChart chart;
+	const size_t employees = 20000;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	for (size_t i = 0; i < employees; ++i) {
+		chart.add_sub("CEO", "Employee" + std::to_string(i));
+	}
+
+	size_t count = 0;
+	auto iter = chart.begin_reverse_order();
+	CHECK(*iter == "Employee0");
+	for (; iter != chart.reverse_order(); ++iter) {
+		++count;
+	}
+	CHECK(count == employees + 1);
+}
+
+TEST_CASE("add_subordinate_between_iterations_expect_new_order") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+
+	size_t count = 0;
+	for (auto iter = chart.begin_preorder(); iter != chart.end_preorder(); ++iter) {
+		++count;
+	}
+	CHECK(count == 2);
+
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_root("Chairman"));
+
+	std::string level_order;
+	for (auto iter = chart.begin_level_order(); iter != chart.end_level_order(); ++iter) {
+		level_order += std::string(*iter) + " ";
+	}
+	CHECK(level_order == "Chairman CTO VP_SW ");
+
+	std::string preorder;
+	for (auto iter = chart.begin_preorder(); iter != chart.end_preorder(); ++iter) {
+		preorder += std::string(*iter) + " ";
+	}
+	CHECK(preorder == "Chairman CTO VP_SW ");
+}
+
+TEST_CASE("jump_with_random_access_iterators_expect_same_as_stepping") {
+	ariel::OrgChart chart;
+	const size_t employees = 1000;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	for (size_t i = 0; i < employees; ++i) {
+		chart.add_sub(i < 10 ? "CEO" : "Employee" + std::to_string(i / 10), "Employee" + std::to_string(i));
+	}
+
+	static_assert(std::is_same_v<std::iterator_traits<ariel::OrgChart::LevelOrderIterator>::iterator_category,
+		std::random_access_iterator_tag>);
+	static_assert(std::is_same_v<std::iterator_traits<ariel::OrgChart::PreorderIterator>::reference, const ariel::OrgChart::Rank&>);
+
+	auto begin = chart.begin_level_order();
+	auto end = chart.end_level_order();
+	CHECK(std::distance(begin, end) == employees + 1);
+	CHECK(chart.size() == employees + 1);
+
+	auto stepped = begin;
+	for (int i = 0; i < 500; ++i) {
+		++stepped;
+	}
+	CHECK(*(begin + 500) == *stepped);
+	auto advanced = begin;
+	std::advance(advanced, 500);
+	CHECK(advanced == stepped);
+	CHECK(&*advanced == &begin[500]);
+	CHECK(advanced->size() == stepped->size());
+	CHECK(begin[500] == *stepped);
+	CHECK((begin + 500) - begin == 500);
+	CHECK(*(end - 1) == "Employee999");
+	CHECK(*(chart.begin_reverse_order() + 999) == "Employee9");
+	CHECK(begin < end);
+	CHECK(chart.begin_preorder()[3] == "Employee10");
+}
+
+TEST_CASE("compare_iterators_at_repeated_titles_expect_different_positions") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "Analyst"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "Analyst"));
+
+	auto first = chart.begin_level_order() + 1;
+	auto second = chart.begin_level_order() + 2;
+	CHECK(*first == *second);
+	CHECK(first != second);
+	CHECK(++first == second);
+	CHECK(++second == chart.end_level_order());
+}
+
+TEST_CASE("copy_ranks_into_strings_expect_same_names") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+
+	auto iter = chart.begin_preorder();
+	std::string root = *iter;
+	CHECK(root == "CEO");
+
+	std::vector<std::string> names;
+	for (; iter != chart.end_preorder(); ++iter) {
+		names.push_back(*iter);
+	}
+	CHECK(names == std::vector<std::string>{"CEO", "CTO", "VP_SW"});
+
+	std::string assigned;
+	assigned = chart.begin_level_order()[1];
+	CHECK(assigned == "CTO");
+	CHECK(std::string(chart.begin_reverse_order()->str().c_str()) == "VP_SW");
+	CHECK(chart.begin_preorder()->size() == 3);
+
+	// A rank can name a level of the chart it was read from
+	CHECK_NOTHROW(chart.add_sub(chart.begin_reverse_order()[0], "Programmer"));
+	CHECK(*(chart.end_level_order() - 1) == "Programmer");
+}
+
+TEST_CASE("read_ranks_like_strings_expect_string_members_work") {
+	ariel::OrgChart chart;
+	const std::string long_title(ariel::PersistentVector<char>::CHUNK_SIZE - 2, 'x');
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", long_title));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+
+	auto iter = chart.begin_level_order();
+	CHECK(std::string(iter->c_str()) == "CEO");
+	CHECK(iter->size() == 3);
+	CHECK(iter->length() == 3);
+	CHECK(!iter->empty());
+	CHECK(*iter == std::string("CEO"));
+	CHECK(std::string("CEO") == *iter);
+	CHECK(*iter != "CTO");
+	CHECK(*iter < std::string("CFO"));
+	CHECK(*iter + " " + iter[1] == "CEO CTO");
+	CHECK("[" + *iter + ']' == "[CEO]");
+
+	std::ostringstream names;
+	for (const auto& name: chart.preorder()) {
+		names << name << " ";
+	}
+	CHECK(names.str() == "CEO CTO VP_SW " + long_title + " ");
+
+	// Every name is followed by a '\0' in the chart, a long one too, also after a save and a mapping
+	const std::string path = "test_rank_strings.orgchart";
+	chart.save(path);
+	ariel::OrgChart mapped = ariel::OrgChart::map(path, true);
+	for (ariel::OrgChart* read: {&chart, &mapped}) {
+		std::vector<std::string> c_strings;
+		for (auto name = read->begin_level_order(); name != read->end_level_order(); ++name) {
+			c_strings.emplace_back(name->c_str());
+		}
+		CHECK(c_strings == std::vector<std::string>{"CEO", "CTO", long_title, "VP_SW"});
+	}
+	std::remove(path.c_str());
+}
+
+TEST_CASE("move_chart_with_iterators_outstanding_expect_iterators_still_walk_it") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "VP_SW"));
+
+	auto begin = chart.begin_level_order();
+	auto end = chart.end_level_order();
+	auto view = chart.preorder();
+	ariel::OrgChart moved = std::move(chart);
+
+	std::string level_order;
+	for (auto iter = begin; iter != end; ++iter) {
+		level_order += std::string(*iter) + " ";
+	}
+	CHECK(level_order == "CEO CTO CFO VP_SW ");
+	CHECK(view.size() == 4);
+	CHECK(view.begin()[2] == "VP_SW");
+
+	// Growing a vector of charts moves them to a new buffer
+	std::vector<ariel::OrgChart> charts;
+	charts.push_back(std::move(moved));
+	auto reverse = charts[0].begin_reverse_order();
+	for (int i = 0; i < 100; ++i) {
+		charts.emplace_back();
+	}
+	CHECK(*reverse == "VP_SW");
+	CHECK(reverse[3] == "CEO");
+	CHECK(charts[0].reverse_order() - reverse == 4);
+}
+
+TEST_CASE("compose_traversal_views_with_range_adaptors_expect_lazy_orders") {
+	ariel::OrgChart chart;
+
+	CHECK(chart.level_order().empty());
+	CHECK(chart.preorder().begin() == chart.preorder().end());
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "VP_HW"));
+	CHECK_NOTHROW(chart.add_sub("VP_SW", "Programmer"));
+	CHECK_NOTHROW(chart.add_sub("VP_HW", "Engineer"));
+
+	std::vector<std::string> preorder;
+	for (std::string_view level : chart.preorder()) {
+		preorder.emplace_back(level);
+	}
+	CHECK(preorder == std::vector<std::string>{"CEO", "VP_SW", "Programmer", "VP_HW", "Engineer"});
+	CHECK(chart.reverse_level_order().size() == 5);
+	CHECK(*chart.reverse_level_order().begin() == "Programmer");
+	CHECK(chart.level_order().end() - chart.level_order().begin() == 5);
+
+#if defined(__cpp_lib_ranges)
+	static_assert(std::ranges::random_access_range<ariel::OrgChart::LevelOrderView>);
+	static_assert(std::ranges::sized_range<ariel::OrgChart::ReverseOrderView>);
+	static_assert(std::ranges::view<ariel::OrgChart::PreorderView>);
+	static_assert(std::ranges::borrowed_range<ariel::OrgChart::PreorderView>);
+
+	std::vector<std::string> vps;
+	auto is_vp = [](std::string_view level) { return level.substr(0, 3) == "VP_"; };
+	for (std::string_view level : chart.level_order() | std::views::filter(is_vp) | std::views::take(1)) {
+		vps.emplace_back(level);
+	}
+	CHECK(vps == std::vector<std::string>{"VP_SW"});
+	CHECK(std::ranges::distance(chart.preorder() | std::views::drop(2)) == 3);
+	CHECK(*std::ranges::find(chart.preorder(), "VP_HW") == "VP_HW");
+#endif
+}
+
+TEST_CASE("add_very_deep_chain_expect_copy_walk_and_destroy_without_recursion") {
+	const int depth = 200000;
+	auto chart = std::make_unique<ariel::OrgChart>();
+
+	CHECK_NOTHROW(chart->add_root("Employee0"));
+	for (int i = 1; i < depth; ++i) {
+		chart->add_sub("Employee" + std::to_string(i - 1), "Employee" + std::to_string(i));
+	}
+
+	auto copy = std::make_unique<ariel::OrgChart>(*chart);
+	chart.reset();
+
+	CHECK(copy->size() == depth);
+	CHECK(*copy->begin_level_order() == "Employee0");
+	CHECK(*copy->begin_reverse_order() == "Employee199999");
+	CHECK(*(copy->end_preorder() - 1) == "Employee199999");
+	CHECK(std::distance(copy->begin_preorder(), copy->end_preorder()) == depth);
+	CHECK_NOTHROW(copy->add_sub("Employee199999", "Intern"));
+	CHECK(*copy->begin_reverse_order() == "Intern");
+	CHECK_NOTHROW(copy.reset());
+}
+
+TEST_CASE("modify_copies_sharing_a_chart_expect_each_keeps_its_own_ranks") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+
+	ariel::OrgChart worker = chart;
+	ariel::OrgChart other_worker;
+	other_worker = worker;
+
+	auto original = chart.begin_level_order();
+	CHECK_NOTHROW(worker.add_sub("CTO", "Programmer"));
+	CHECK_NOTHROW(other_worker.add_root("Owner"));
+	CHECK_NOTHROW(other_worker.add_sub("Owner", "Accountant"));
+
+	// The original's iterators aren't touched by the modifications of its copies
+	CHECK(*original == "CEO");
+	CHECK(*++original == "CTO");
+	CHECK(++original == chart.end_level_order());
+
+	CHECK(chart.size() == 2);
+	CHECK(worker.size() == 3);
+	CHECK(*(worker.end_level_order() - 1) == "Programmer");
+	CHECK(*other_worker.begin_level_order() == "Owner");
+	CHECK(*other_worker.begin_reverse_order() == "CTO");
+	CHECK(other_worker.begin_reverse_order()[1] == "Accountant");
+	CHECK_THROWS(chart.add_sub("Owner", "Intern"));
+	CHECK_THROWS(worker.add_sub("Accountant", "Intern"));
+}
+
+TEST_CASE("edit_copy_of_large_tree_expect_only_touched_chunks_copied") {
+	const ariel::NodeId size = 200000;
+	ariel::FlatTree tree;
+	tree.add_root("CEO");
+	for (ariel::NodeId node = 1; node < size; ++node) {
+		tree.add_child((node * 7919) % node, "Employee" + std::to_string(node));
+	}
+
+	// The copy shares everything until it's edited, then holds only the chunks it wrote
+	ariel::FlatTree copy = tree;
+	CHECK(copy.memory_usage(true) < 1000);
+	CHECK(copy.add_child(size / 2, "Intern") == size);
+	CHECK(copy.add_child(1, "Employee3") == size + 1);
+	CHECK(copy.memory_usage(true) * 10 < tree.memory_usage());
+	CHECK(tree.memory_usage(true) * 10 < tree.memory_usage());
+
+	CHECK(tree.size() == size);
+	CHECK(tree.first_child(size / 2) != size);
+	CHECK(tree.find_node_by_value("Intern") == ariel::NO_NODE);
+	CHECK(copy.parent(size) == size / 2);
+	CHECK(copy.find_node_by_value("Employee3") == size + 1);
+	CHECK(tree.find_node_by_value("Employee3") == 3);
+
+	// A name longer than a chunk stays in a row, also in a chart saved, loaded and mapped
+	const std::string long_title(3 * ariel::PersistentVector<char>::CHUNK_SIZE + 5, 'x');
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CTO", long_title));
+	ariel::OrgChart chart_copy = chart;
+	CHECK_NOTHROW(chart_copy.add_sub(long_title, "Intern"));
+	CHECK_NOTHROW(chart_copy.add_sub("Intern", "Trainee"));
+	CHECK(chart.size() == 3);
+	CHECK(chart_copy.depth("Trainee") == 4);
+	CHECK(*(chart_copy.begin_level_order() + 2) == long_title);
+
+	const std::string path = "test_long_title.orgchart";
+	CHECK_NOTHROW(chart_copy.save(path));
+	std::vector<ariel::OrgChart> reads;
+	reads.push_back(ariel::OrgChart::load(path));
+	reads.push_back(ariel::OrgChart::map(path, true));
+	reads.push_back(chart_copy.deep_copy());
+	for (ariel::OrgChart& read: reads) {
+		CHECK(std::equal(read.begin_preorder(), read.end_preorder(), chart_copy.begin_preorder(), chart_copy.end_preorder()));
+		CHECK(read.depth(long_title) == 2);
+	}
+	std::remove(path.c_str());
+}
+
+TEST_CASE("read_older_versions_of_chart_expect_ranks_at_that_time") {
+	ariel::OrgChart chart;
+	CHECK(chart.version() == 0);
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	ariel::OrgChart audited = chart.at_version(chart.version());
+	CHECK_NOTHROW(chart.add_sub("CTO", "Programmer"));
+	CHECK_NOTHROW(chart.add_root("Owner"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "Tester"));
+	CHECK(chart.version() == 6);
+
+	// Modifying the chart doesn't change its older versions
+	CHECK(audited.size() == 3);
+	CHECK(audited.version() == 3);
+	std::vector<std::string> preorder;
+	for (std::string_view level: audited.preorder()) {
+		preorder.emplace_back(level);
+	}
+	CHECK(preorder == std::vector<std::string>{"CEO", "CTO", "CFO"});
+
+	CHECK(chart.at_version(0).size() == 0);
+	CHECK_THROWS(chart.at_version(0).begin_level_order());
+	CHECK(*chart.at_version(1).begin_preorder() == "CEO");
+	CHECK(*chart.at_version(4).begin_reverse_order() == "Programmer");
+	CHECK(*(chart.at_version(4).end_level_order() - 1) == "Programmer");
+	CHECK(*chart.at_version(5).begin_level_order() == "Owner");
+	CHECK(chart.at_version(5).size() == 4);
+	CHECK(*chart.begin_level_order() == "Owner");
+	CHECK(*(chart.end_preorder() - 2) == "Tester");
+	CHECK_THROWS_AS(chart.at_version(7), std::out_of_range);
+
+	// Versions are read only, but their copies and versions can be read like them
+	CHECK_THROWS_AS(audited.add_sub("CEO", "Intern"), std::logic_error);
+	CHECK_THROWS_AS(audited.add_root("Intern"), std::logic_error);
+	ariel::OrgChart copy = audited;
+	CHECK(copy.size() == 3);
+	CHECK_THROWS(copy.add_sub("CTO", "Intern"));
+	CHECK(audited.at_version(2).size() == 2);
+	CHECK_THROWS(audited.at_version(4));
+
+	// The names the version listed are read again once the chart's new names moved them
+	CHECK(*(audited.begin_preorder() + 2) == "CFO");
+	for (int i = 0; i < 1000; ++i) {
+		chart.add_sub("Owner", "Employee" + std::to_string(i));
+	}
+	CHECK(*(audited.begin_preorder() + 2) == "CFO");
+	CHECK(audited.preorder().begin()[1] == "CTO");
+}
+
+TEST_CASE("read_versions_with_repeated_titles_expect_names_resolved_at_each") {
+	// The level order puts the X under R first, though the one under A is first in preorder
+	ariel::ChartBuilder builder;
+	builder.add_root("R").add_sub("R", "A").add_sub("A", "X").add_sub("R", "X");
+	ariel::OrgChart built = builder.build();
+	ariel::OrgChart built_version = built.at_version(3);
+	std::vector<std::string> level_order;
+	for (std::string_view level: built_version.level_order()) {
+		level_order.emplace_back(level);
+	}
+	CHECK(level_order == std::vector<std::string>{"R", "A", "X"});
+	CHECK(built_version.depth("X") == 1);
+	CHECK(built.at_version(4).depth("X") == 2);
+	CHECK(built.depth("X") == 2);
+
+	// The CTO's Analyst comes before the CFO's, which was the first until it was added
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(chart.add_sub("CFO", "Analyst"));
+	CHECK_NOTHROW(chart.add_sub("CTO", "Analyst"));
+	CHECK(chart.at_version(4).is_under("Analyst", "CFO"));
+	CHECK(chart.at_version(5).is_under("Analyst", "CTO"));
+	CHECK_THROWS(chart.at_version(3).depth("Analyst"));
+
+	// Also once saved, loaded and mapped
+	const std::string path = "test_versions.orgchart";
+	CHECK_NOTHROW(chart.save(path));
+	CHECK(ariel::OrgChart::load(path).at_version(4).is_under("Analyst", "CFO"));
+	CHECK(ariel::OrgChart::map(path).at_version(4).is_under("Analyst", "CFO"));
+	CHECK(ariel::OrgChart::map(path, true).at_version(5).is_under("Analyst", "CTO"));
+	std::remove(path.c_str());
+
+	// A version is read on another thread while the chart is modified
+	ariel::OrgChart version = chart.at_version(chart.version());
+	bool same_levels = true;
+	std::thread reader([&]() {
+		for (int pass = 0; pass < 100; ++pass) {
+			ariel::OrgChart copy = version;
+			same_levels = same_levels && copy.size() == 5 && copy.depth("Analyst") == 2 &&
+				std::distance(copy.begin_preorder(), copy.end_preorder()) == 5;
+		}
+	});
+	for (int i = 0; i < 5000; ++i) {
+		chart.add_sub(i % 2 == 0 ? "Analyst" : "CFO", "Employee" + std::to_string(i));
+	}
+	reader.join();
+	CHECK(same_levels);
+	CHECK(chart.size() == 5005);
+}
+
+TEST_CASE("build_chart_from_unordered_subordinates_expect_level_order_layout") {
+	ariel::ChartBuilder builder;
+
+	CHECK_NOTHROW(builder.add_sub("CTO", "Programmer"));
+	CHECK_NOTHROW(builder.add_sub("CEO", "CTO"));
+	CHECK_NOTHROW(builder.add_sub("Programmer", "Intern"));
+	CHECK_NOTHROW(builder.add_sub("CEO", "CFO"));
+	CHECK_NOTHROW(builder.add_sub("CTO", "Tester"));
+	CHECK_NOTHROW(builder.add_sub("CFO", "Programmer"));
+	CHECK_THROWS(builder.build());
+	CHECK_NOTHROW(builder.add_root("CEO"));
+	CHECK_THROWS_AS(builder.add_sub("CEO", ""), std::invalid_argument);
+	CHECK(builder.size() == 6);
+
+	ariel::OrgChart chart = builder.build();
+	CHECK(chart.size() == 7);
+
+	std::vector<std::string> level_order;
+	for (std::string_view level: chart.level_order()) {
+		level_order.emplace_back(level);
+	}
+	CHECK(level_order == std::vector<std::string>{"CEO", "CTO", "CFO", "Programmer", "Tester", "Programmer", "Intern"});
+
+	std::vector<std::string> preorder;
+	for (std::string_view level: chart.preorder()) {
+		preorder.emplace_back(level);
+	}
+	CHECK(preorder == std::vector<std::string>{"CEO", "CTO", "Programmer", "Intern", "Tester", "CFO", "Programmer"});
+
+	// The built chart can be modified and versioned like any other
+	CHECK_NOTHROW(chart.add_sub("Intern", "Trainee"));
+	CHECK(*chart.begin_reverse_order() == "Trainee");
+	CHECK(chart.at_version(3).size() == 3);
+}
+
+TEST_CASE("build_chart_with_missing_or_cyclic_parents_expect_exception") {
+	ariel::ChartBuilder missing;
+	missing.add_root("CEO").add_sub("CEO", "CTO").add_sub("VP", "Programmer");
+	CHECK_THROWS_AS(missing.build(), std::logic_error);
+
+	ariel::ChartBuilder cycle;
+	cycle.add_root("CEO").add_sub("CEO", "CTO").add_sub("Manager", "Lead").add_sub("Lead", "Manager");
+	CHECK_THROWS_AS(cycle.build(), std::logic_error);
+
+	ariel::ChartBuilder root_only;
+	root_only.add_root("Founder");
+	CHECK(*root_only.build().begin_level_order() == "Founder");
+}
+
+TEST_CASE("build_chart_with_repeated_titles_expect_same_lookups_as_add_sub") {
+	ariel::OrgChart added;
+	ariel::ChartBuilder builder;
+
+	// The first X is under A, so the level order puts the X under R before it
+	CHECK_NOTHROW(added.add_root("R"));
+	CHECK_NOTHROW(builder.add_root("R"));
+	for (const auto& [parent, child]: std::vector<std::pair<std::string, std::string>>{{"R", "A"}, {"A", "X"}, {"R", "X"}, {"X", "Y"}}) {
+		CHECK_NOTHROW(added.add_sub(parent, child));
+		CHECK_NOTHROW(builder.add_sub(parent, child));
+	}
+
+	ariel::OrgChart built = builder.build();
+	CHECK(added.depth("X") == 2);
+	CHECK(built.depth("X") == 2);
+	CHECK(built.headcount("X") == added.headcount("X"));
+	CHECK(built.is_under("Y", "X"));
+	CHECK(built.is_under("Y", "A"));
+	CHECK(built.common_manager("Y", "A") == added.common_manager("Y", "A"));
+
+	CHECK_NOTHROW(added.add_sub("X", "Z"));
+	CHECK_NOTHROW(built.add_sub("X", "Z"));
+	CHECK(built.depth("Z") == 3);
+	CHECK(std::equal(built.begin_preorder(), built.end_preorder(), added.begin_preorder(), added.end_preorder()));
+
+	// Saved and read back, the names stay with the same levels
+	const std::string path = "test_built_chart.orgchart";
+	CHECK_NOTHROW(builder.build().save(path));
+	CHECK(ariel::OrgChart::load(path).depth("X") == 2);
+	CHECK(ariel::OrgChart::map(path, true).is_under("Y", "X"));
+	std::remove(path.c_str());
+
+	// A name moves to a level added later but earlier in preorder, and a subordinate given
+	// before any level with its parent's name goes under the first one
+	ariel::OrgChart moved;
+	ariel::ChartBuilder moved_builder;
+	CHECK_NOTHROW(moved.add_root("CEO"));
+	CHECK_NOTHROW(moved_builder.add_root("CEO").add_sub("Analyst", "Trainee"));
+	for (const auto& [parent, child]: std::vector<std::pair<std::string, std::string>>{
+			 {"CEO", "CTO"}, {"CEO", "CFO"}, {"CFO", "Analyst"}, {"CTO", "Analyst"}, {"Analyst", "Intern"}}) {
+		CHECK_NOTHROW(moved.add_sub(parent, child));
+		CHECK_NOTHROW(moved_builder.add_sub(parent, child));
+		if (child == "Analyst" && parent == "CFO") {
+			CHECK_NOTHROW(moved.add_sub("Analyst", "Trainee"));
+		}
+	}
+	ariel::OrgChart moved_built = moved_builder.build();
+	CHECK(std::equal(moved_built.begin_preorder(), moved_built.end_preorder(), moved.begin_preorder(), moved.end_preorder()));
+	CHECK(moved_built.is_under("Intern", "CTO"));
+	CHECK(moved_built.is_under("Trainee", "CFO"));
+}
+
+TEST_CASE("build_large_chart_on_several_threads_expect_same_as_add_sub") {
+	const size_t size = 30000;
+	const size_t titles = 1000;
+	ariel::OrgChart added;
+	ariel::ChartBuilder builder;
+
+	added.add_root("Title0");
+	builder.add_root("Title0");
+	for (size_t i = 1; i < size; ++i) {
+		// Every level reports to one of the titles added a bit before it
+		std::string parent = "Title" + std::to_string((i * 7919) % std::min(i, titles));
+		std::string child = "Title" + std::to_string(i % titles);
+		added.add_sub(parent, child);
+		builder.add_sub(parent, child);
+	}
+
+	for (unsigned threads: {1U, 4U, 32U}) {
+		ariel::OrgChart built = builder.build(threads);
+		CHECK(built.size() == size);
+		CHECK(std::equal(built.begin_level_order(), built.end_level_order(), added.begin_level_order(), added.end_level_order()));
+		CHECK(std::equal(built.begin_reverse_order(), built.reverse_order(), added.begin_reverse_order(), added.reverse_order()));
+		CHECK(std::equal(built.begin_preorder(), built.end_preorder(), added.begin_preorder(), added.end_preorder()));
+
+		// Every title names the same level in both, though most are repeated
+		bool same_lookups = true;
+		for (size_t title = 0; title < titles; ++title) {
+			std::string level = "Title" + std::to_string(title);
+			std::string other = "Title" + std::to_string((title * 31) % titles);
+			same_lookups = same_lookups && built.depth(level) == added.depth(level) &&
+				built.headcount(level) == added.headcount(level) &&
+				built.is_under(level, other) == added.is_under(level, other) &&
+				built.common_manager(level, other) == added.common_manager(level, other);
+		}
+		CHECK(same_lookups);
+	}
+}
+
+TEST_CASE("deep_copy_and_destroy_in_background_expect_charts_unaffected") {
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	for (int i = 0; i < 100; ++i) {
+		CHECK_NOTHROW(chart.add_sub("CEO", "Manager" + std::to_string(i)));
+		CHECK_NOTHROW(chart.add_sub("Manager" + std::to_string(i), "Employee" + std::to_string(i)));
+	}
+
+	ariel::OrgChart copy = chart.deep_copy(4);
+	CHECK(copy.size() == chart.size());
+	CHECK(std::equal(copy.begin_preorder(), copy.end_preorder(), chart.begin_preorder(), chart.end_preorder()));
+	CHECK_NOTHROW(copy.add_sub("Employee99", "Intern"));
+	CHECK(chart.size() == 201);
+	CHECK(*chart.at_version(3).deep_copy(2).begin_reverse_order() == "Employee0");
+
+	ariel::OrgChart::destroy_in_background(true);
+	{
+		// The last reference to the copy's nodes is dropped in the background, while the
+		// nodes shared with the chart stay alive for it
+		ariel::OrgChart shared = chart;
+		ariel::OrgChart moved = std::move(copy);
+		CHECK(*moved.begin_reverse_order() == "Intern");
+	}
+	ariel::OrgChart::destroy_in_background(false);
+
+	CHECK(*chart.begin_reverse_order() == "Employee0");
+	CHECK(copy.size() == 0);
+}
+
+TEST_CASE("iterate_under_a_level_expect_only_its_subordinates") {
+	ariel::OrgChart chart;
+
+	CHECK_NOTHROW(chart.add_root("CEO"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "VP_SW"));
+	CHECK_NOTHROW(chart.add_sub("CEO", "VP_HW"));
+	CHECK_NOTHROW(chart.add_sub("VP_SW", "Team_Lead"));
+	CHECK_NOTHROW(chart.add_sub("VP_SW", "Architect"));
+	CHECK_NOTHROW(chart.add_sub("VP_HW", "Team_Lead"));
+	CHECK_NOTHROW(chart.add_sub("Team_Lead", "Programmer"));
+	CHECK_NOTHROW(chart.add_sub("Architect", "Designer"));
+
+	std::vector<std::string> levels;
+	for (auto iter = chart.begin_level_order("VP_SW"); iter != chart.end_level_order("VP_SW"); ++iter) {
+		levels.emplace_back(*iter);
+	}
+	CHECK(levels == std::vector<std::string>{"VP_SW", "Team_Lead", "Architect", "Programmer", "Designer"});
+
+	levels.clear();
+	for (auto iter = chart.begin_reverse_order("VP_SW"); iter != chart.reverse_order("VP_SW"); ++iter) {
+		levels.emplace_back(*iter);
+	}
+	CHECK(levels == std::vector<std::string>{"Programmer", "Designer", "Team_Lead", "Architect", "VP_SW"});
+
+	levels.clear();
+	for (std::string_view level: chart.preorder("VP_SW")) {
+		levels.emplace_back(level);
+	}
+	CHECK(levels == std::vector<std::string>{"VP_SW", "Team_Lead", "Programmer", "Architect", "Designer"});
+
+	// A repeated title is the first one in preorder, like for add_sub
+	CHECK(std::distance(chart.begin_preorder("Team_Lead"), chart.end_preorder("Team_Lead")) == 2);
+	CHECK(chart.level_order("VP_HW").size() == 2);
+	CHECK(chart.reverse_level_order("CEO").size() == chart.size());
+	CHECK(*chart.begin_level_order("Designer") == "Designer");
+	CHECK_THROWS(chart.begin_level_order("CFO"));
+	CHECK_THROWS(chart.end_preorder("CFO"));
+
+	// Under a level of an older version, only what it had then
+	ariel::OrgChart version = chart.at_version(5);
+	CHECK(version.preorder("VP_SW").size() == 3);
+	CHECK_THROWS(version.begin_preorder("Programmer"));
+	CHECK_NOTHROW(chart.add_root("Owner"));
+	CHECK(*chart.at_version(8).begin_level_order("CEO") == "CEO");
+	CHECK_THROWS(chart.begin_level_order("CEO"));
+}
+
+TEST_CASE("check_reporting_lines_expect_same_as_walking_up_the_chart") {
+	const size_t size = 2000;
+	std::vector<size_t> parents(size, 0);
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("Employee0"));
+	for (size_t i = 1; i < size; ++i) {
+		parents[i] = (i * 7919) % i;
+		chart.add_sub("Employee" + std::to_string(parents[i]), "Employee" + std::to_string(i));
+	}
+
+	for (size_t level = 0; level < size; level += 37) {
+		for (size_t manager = 0; manager < size; manager += 13) {
+			bool walked = false;
+			for (size_t above = level; above != 0 && !walked;) {
+				above = parents[above];
+				walked = above == manager;
+			}
+			CHECK(chart.is_under("Employee" + std::to_string(level), "Employee" + std::to_string(manager)) == walked);
+		}
+	}
+
+	CHECK(chart.is_under("Employee1", "Employee0"));
+	CHECK_FALSE(chart.is_under("Employee0", "Employee0"));
+	CHECK_FALSE(chart.is_under("Employee0", "Employee1"));
+	CHECK_THROWS(chart.is_under("Employee1", "CEO"));
+
+	// The index follows modifications and versions
+	CHECK_NOTHROW(chart.add_sub("Employee1999", "Intern"));
+	CHECK(chart.is_under("Intern", "Employee0"));
+	CHECK(chart.is_under("Intern", "Employee1999"));
+	CHECK_THROWS(chart.at_version(2).is_under("Employee2", "Employee0"));
+	CHECK(chart.at_version(3).is_under("Employee2", "Employee0"));
+}
+
+TEST_CASE("check_common_managers_expect_same_as_walking_up_the_chart") {
+	const size_t size = 3000;
+	std::vector<size_t> parents(size, 0);
+	std::vector<size_t> depths(size, 0);
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("Employee0"));
+	for (size_t i = 1; i < size; ++i) {
+		parents[i] = (i * 2654435761U >> 8U) % i;
+		depths[i] = depths[parents[i]] + 1;
+		chart.add_sub("Employee" + std::to_string(parents[i]), "Employee" + std::to_string(i));
+	}
+
+	std::vector<std::pair<std::string, std::string>> pairs;
+	std::vector<std::string> walked;
+	for (size_t first = 0; first < size; first += 29) {
+		for (size_t second = 1; second < size; second += 31) {
+			size_t a = first;
+			size_t b = second;
+			while (a != b) {
+				if (depths[a] >= depths[b]) {
+					a = parents[a];
+				} else {
+					b = parents[b];
+				}
+			}
+			pairs.emplace_back("Employee" + std::to_string(first), "Employee" + std::to_string(second));
+			walked.push_back("Employee" + std::to_string(a));
+			CHECK(chart.common_manager(pairs.back().first, pairs.back().second) == walked.back());
+		}
+	}
+
+	std::vector<std::string_view> batched = chart.common_managers(pairs, 4);
+	CHECK(std::equal(batched.begin(), batched.end(), walked.begin(), walked.end()));
+	CHECK(chart.common_manager("Employee5", "Employee5") == "Employee5");
+	CHECK(chart.common_manager("Employee0", "Employee5") == "Employee0");
+	CHECK_THROWS(chart.common_manager("Employee1", "CEO"));
+	CHECK_THROWS(chart.common_managers({{"Employee1", "Employee2"}, {"CEO", "Employee2"}}));
+
+	// The index follows modifications and versions, with the root's name at the version
+	CHECK_NOTHROW(chart.add_sub("Employee2999", "Intern"));
+	CHECK_NOTHROW(chart.add_sub("Employee2999", "Student"));
+	CHECK(chart.common_manager("Intern", "Student") == "Employee2999");
+	CHECK(chart.common_manager("Intern", "Employee2999") == "Employee2999");
+	CHECK_NOTHROW(chart.add_root("Owner"));
+	CHECK(chart.common_manager("Intern", "Employee1") == chart.common_manager("Employee2999", "Employee1"));
+	CHECK(chart.at_version(3).common_manager("Employee1", "Employee0") == "Employee0");
+	CHECK(chart.common_manager("Employee1", "Owner") == "Owner");
+	CHECK_THROWS(chart.at_version(3).common_manager("Employee1", "Employee3"));
+}
+
+TEST_CASE("check_headcounts_and_depths_expect_same_as_counting_the_levels") {
+	const size_t size = 3000;
+	std::vector<size_t> parents(size, 0);
+	std::vector<size_t> depths(size, 0);
+	std::vector<size_t> headcounts(size, 0);
+	ariel::OrgChart chart;
+	CHECK_NOTHROW(chart.add_root("Employee0"));
+	for (size_t i = 1; i < size; ++i) {
+		parents[i] = (i * 2654435761U >> 8U) % i;
+		depths[i] = depths[parents[i]] + 1;
+		chart.add_sub("Employee" + std::to_string(parents[i]), "Employee" + std::to_string(i));
+		for (size_t above = i; above != 0;) {
+			above = parents[above];
+			++headcounts[above];
+		}
+
+		// Counted again every few levels, so some are added one by one and some in batches
+		if (i % 97 == 0 || i > size - 5) {
+			for (size_t level = 0; level <= i; level += 11) {
+				CHECK(chart.headcount("Employee" + std::to_string(level)) == headcounts[level]);
+				CHECK(chart.depth("Employee" + std::to_string(level)) == depths[level]);
+			}
+		}
+	}
+
+	CHECK(chart.headcount("Employee0") == size - 1);
+	CHECK(chart.headcount("Employee2999") == 0);
+	CHECK_THROWS(chart.headcount("CEO"));
+	CHECK_THROWS(chart.depth("CEO"));
+
+	// Versions and copies count only their own levels
+	ariel::OrgChart version = chart.at_version(100);
+	CHECK(version.headcount("Employee0") == 99);
+	CHECK_THROWS(version.headcount("Employee100"));
+	ariel::OrgChart copy = chart;
+	CHECK_NOTHROW(copy.add_sub("Employee2999", "Intern"));
+	CHECK(copy.headcount("Employee0") == size);
+	CHECK(copy.depth("Intern") == depths[2999] + 1);
+	CHECK(chart.headcount("Employee0") == size - 1);
+	copy = version;
+	CHECK(copy.headcount("Employee0") == 99);
+	CHECK_NOTHROW(chart.add_root("Owner"));
+	CHECK(chart.headcount("Owner") == size - 1);
+	CHECK(chart.depth("Owner") == 0);
+}
+
+TEST_CASE("write_chart_in_every_format_expect_whole_tree_written") {
+	ariel::OrgChart chart;
+	std::ostringstream empty;
+	empty << chart << ariel::ChartFormat::Json << chart;
+	CHECK(empty.str() == "null\n");
+
+	chart.add_root("CEO").add_sub("CEO", "CTO").add_sub("CEO", "CFO").add_sub("CTO", "VP \"SW\"").add_sub("CFO", "A\\B");
+	std::ostringstream indented;
+	indented << chart;
+	CHECK(indented.str() == "CEO\n  CTO\n    VP \"SW\"\n  CFO\n    A\\B\n");
+
+	std::ostringstream json;
+	json << ariel::ChartFormat::Json << chart;
+	CHECK(json.str() == "{\"name\":\"CEO\",\"subordinates\":[{\"name\":\"CTO\",\"subordinates\":[{\"name\":\"VP \\\"SW\\\"\"}]},"
+		"{\"name\":\"CFO\",\"subordinates\":[{\"name\":\"A\\\\B\"}]}]}\n");
+
+	// The format stays set on the stream
+	json.str("");
+	json << chart.at_version(2);
+	CHECK(json.str() == "{\"name\":\"CEO\",\"subordinates\":[{\"name\":\"CTO\"}]}\n");
+
+	std::ostringstream dot;
+	dot << ariel::ChartFormat::Dot << chart.at_version(3);
+	CHECK(dot.str() == "digraph OrgChart {\n\tn0 [label=\"CEO\"];\n\tn1 [label=\"CTO\"];\n\tn0 -> n1;\n"
+		"\tn2 [label=\"CFO\"];\n\tn0 -> n2;\n}\n");
+
+	// DOT labels keep control characters and bytes past ASCII as they are, and only JSON escapes them
+	ariel::OrgChart titled;
+	titled.add_root("Head\tof \"R&D\"\x01\xc3\xa9\\");
+	dot.str("");
+	dot << titled;
+	CHECK(dot.str() == "digraph OrgChart {\n\tn0 [label=\"Head\tof \\\"R&D\\\"\x01\xc3\xa9\\\\\"];\n}\n");
+	json.str("");
+	json << titled;
+	CHECK(json.str() == "{\"name\":\"Head\\u0009of \\\"R&D\\\"\\u0001\xc3\xa9\\\\\"}\n");
+
+	chart.add_root("Owner");
+	std::ostringstream renamed;
+	chart.write(renamed, ariel::ChartFormat::Indented);
+	CHECK(renamed.str().substr(0, 10) == "Owner\n  CT");
+
+	// Deep and large charts are written without recursion, in many chunks
+	ariel::OrgChart chain;
+	chain.add_root("Employee0");
+	for (size_t i = 1; i < 100000; ++i) {
+		chain.add_sub("Employee" + std::to_string(i - 1), "Employee" + std::to_string(i));
+	}
+	std::ostringstream nested;
+	nested << ariel::ChartFormat::Json << chain;
+	CHECK(nested.str().size() > 2000000);
+	CHECK(nested.str().substr(nested.str().size() - 6) == "}]}]}\n");
+}
+
+TEST_CASE("save_and_load_chart_expect_same_levels_in_same_order") {
+	const std::string path = "test_chart.orgchart";
+	ariel::OrgChart chart;
+	chart.add_root("Employee0");
+	for (size_t i = 1; i < 3000; ++i) {
+		// Repeated names, and children added to a parent long after its first ones
+		size_t parent = (i * 2654435761U >> 8U) % i;
+		chart.add_sub("Employee" + std::to_string(parent), "Employee" + std::to_string(i % 2500));
+	}
+	chart.add_root("CEO");
+	CHECK_NOTHROW(chart.save(path));
+
+	ariel::OrgChart loaded = ariel::OrgChart::load(path);
+	CHECK(loaded.size() == chart.size());
+	CHECK(loaded.version() == chart.size());
+	CHECK(std::equal(loaded.begin_level_order(), loaded.end_level_order(), chart.begin_level_order(), chart.end_level_order()));
+	CHECK(std::equal(loaded.begin_reverse_order(), loaded.reverse_order(), chart.begin_reverse_order(), chart.reverse_order()));
+	CHECK(std::equal(loaded.begin_preorder(), loaded.end_preorder(), chart.begin_preorder(), chart.end_preorder()));
+
+	// A repeated name still refers to the same level
+	chart.add_sub("Employee7", "Intern");
+	loaded.add_sub("Employee7", "Intern");
+	CHECK(std::equal(loaded.begin_preorder(), loaded.end_preorder(), chart.begin_preorder(), chart.end_preorder()));
+
+	// Only the saved version is saved, with the root's name at that version
+	CHECK_NOTHROW(chart.at_version(3).save(path));
+	loaded = ariel::OrgChart::load(path);
+	CHECK(loaded.size() == 3);
+	CHECK(*loaded.begin_level_order() == "Employee0");
+
+	CHECK_NOTHROW(ariel::OrgChart().save(path));
+	CHECK(ariel::OrgChart::load(path).size() == 0);
+	CHECK_THROWS(ariel::OrgChart::load(path).begin_level_order());
+	CHECK_NOTHROW(ariel::OrgChart::load(path).add_root("CEO"));
+
+	// Damaged and missing files aren't loaded
+	CHECK_NOTHROW(chart.save(path));
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(100);
+		file.put('\x7f');
+	}
+	CHECK_THROWS_AS(ariel::OrgChart::load(path), std::runtime_error);
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::app);
+		file.put('\0');
+	}
+	CHECK_THROWS_AS(ariel::OrgChart::load(path), std::runtime_error);
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << "manager,employee\n";
+	}
+	CHECK_THROWS_AS(ariel::OrgChart::load(path), std::runtime_error);
+	std::remove(path.c_str());
+	CHECK_THROWS_AS(ariel::OrgChart::load(path), std::runtime_error);
+}
+
+TEST_CASE("map_saved_chart_expect_same_traversals_and_lookups_read_only") {
+	const std::string path = "test_mapped_chart.orgchart";
+	ariel::OrgChart chart;
+	chart.add_root("Employee0");
+	for (size_t i = 1; i < 3000; ++i) {
+		size_t parent = (i * 2654435761U >> 8U) % i;
+		chart.add_sub("Employee" + std::to_string(parent), "Employee" + std::to_string(i % 2500));
+	}
+	chart.add_root("CEO");
+	CHECK_NOTHROW(chart.save(path));
+
+	ariel::OrgChart mapped = ariel::OrgChart::map(path, true);
+	CHECK(mapped.size() == chart.size());
+	CHECK(std::equal(mapped.begin_level_order(), mapped.end_level_order(), chart.begin_level_order(), chart.end_level_order()));
+	CHECK(std::equal(mapped.begin_reverse_order(), mapped.reverse_order(), chart.begin_reverse_order(), chart.reverse_order()));
+	CHECK(std::equal(mapped.begin_preorder(), mapped.end_preorder(), chart.begin_preorder(), chart.end_preorder()));
+	CHECK(std::equal(mapped.begin_preorder("Employee7"), mapped.end_preorder("Employee7"),
+		chart.begin_preorder("Employee7"), chart.end_preorder("Employee7")));
+	CHECK(mapped.is_under("Employee2499", "CEO"));
+	CHECK(mapped.common_manager("Employee10", "Employee11") == chart.common_manager("Employee10", "Employee11"));
+	CHECK(mapped.headcount("CEO") == chart.size() - 1);
+	CHECK_THROWS(mapped.begin_level_order("Employee2500"));
+
+	// Read only, but a copy of it can be loaded and modified
+	CHECK_THROWS(mapped.add_sub("CEO", "Intern"));
+	CHECK_THROWS(mapped.add_root("Owner"));
+	ariel::OrgChart copy = mapped;
+	CHECK_THROWS(copy.add_sub("CEO", "Intern"));
+	mapped.save(path + ".copy");
+	ariel::OrgChart loaded = ariel::OrgChart::load(path + ".copy");
+	CHECK_NOTHROW(loaded.add_sub("Employee7", "Intern"));
+	chart.add_sub("Employee7", "Intern");
+	CHECK(std::equal(loaded.begin_preorder(), loaded.end_preorder(), chart.begin_preorder(), chart.end_preorder()));
+
+	// An older version links past its last level, which the saved file doesn't
+	ariel::OrgChart version = chart.at_version(40);
+	CHECK_NOTHROW(version.save(path));
+	mapped = ariel::OrgChart::map(path);
+	CHECK(mapped.size() == 40);
+	CHECK(std::equal(mapped.begin_preorder(), mapped.end_preorder(), version.begin_preorder(), version.end_preorder()));
+
+	// A name missing from the saved slots is filed again, instead of being unfindable, even
+	// if the file's checksum matches
+	CHECK_NOTHROW(chart.save(path));
+	{
+		std::string bytes;
+		{
+			std::ifstream file(path, std::ios::binary);
+			bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+		ariel::ChartFile::Header header{};
+		std::copy_n(bytes.data(), sizeof(header), reinterpret_cast<char*>(&header));
+		const size_t slots = bytes.size() - header.slots * sizeof(ariel::NameId);
+		for (size_t slot = slots; slot < bytes.size(); slot += sizeof(ariel::NameId)) {
+			ariel::NameId name = 0;
+			std::copy_n(bytes.data() + slot, sizeof(name), reinterpret_cast<char*>(&name));
+			if (name != ariel::NO_NAME) {
+				std::fill_n(bytes.begin() + static_cast<std::ptrdiff_t>(slot), sizeof(name), '\xff');
+				break;
+			}
+		}
+		ariel::ChartFile::Checksum checksum;
+		checksum.add(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+		header.checksum = checksum.value();
+		std::copy_n(reinterpret_cast<const char*>(&header), sizeof(header), bytes.data());
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+	}
+	loaded = ariel::OrgChart::load(path);
+	mapped = ariel::OrgChart::map(path, true);
+	for (size_t i = 0; i < 2500; ++i) {
+		const std::string title = "Employee" + std::to_string(i);
+		CHECK(loaded.depth(title) == chart.depth(title));
+		CHECK(mapped.depth(title) == chart.depth(title));
+	}
+
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(100);
+		file.put('\x7f');
+	}
+	CHECK_THROWS_AS(ariel::OrgChart::map(path, true), std::runtime_error);
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << "manager,employee\n";
+	}
+	CHECK_THROWS_AS(ariel::OrgChart::map(path), std::runtime_error);
+	std::remove(path.c_str());
+	std::remove((path + ".copy").c_str());
+	CHECK_THROWS_AS(ariel::OrgChart::map(path), std::runtime_error);
+}
+
+TEST_CASE("import_csv_rows_expect_same_chart_as_built_from_them") {
+	auto import = [](const std::string& text, char delimiter = ',', bool header = false) {
+		std::istringstream input(text);
+		ariel::ChartBuilder builder;
+		ariel::ChartImporter importer(delimiter, header);
+		importer.read(input, builder);
+		return std::pair(builder.build(), importer.stats().rows);
+	};
+	auto preorder = [](ariel::OrgChart chart) {
+		return std::vector<std::string>(chart.begin_preorder(), chart.end_preorder());
+	};
+
+	// Out of order rows, a header, CRLF line ends, quoted fields and a missing last line end
+	auto [chart, rows] = import("\xEF\xBB\xBFmanager,employee\r\nCTO,Programmer\r\n,CEO\r\n\r\n"
+		"CEO,CTO\r\n\"CEO\",\"Smith, \"\"Bob\"\"\"\r\n\"Smith, \"\"Bob\"\"\",\"Two\nLines\"", ',', true);
+	CHECK(rows == 5);
+	CHECK(preorder(chart) == std::vector<std::string>{"CEO", "CTO", "Programmer", "Smith, \"Bob\"", "Two\nLines"});
+	CHECK(preorder(import("CEO\nCEO\tCTO\n\"CTO\"\t\"\"\"\"\n", '\t').first) == std::vector<std::string>{"CEO", "CTO", "\""});
+	CHECK(ariel::ChartImporter::delimiter_of("chart.tsv") == '\t');
+	CHECK(ariel::ChartImporter::delimiter_of("chart.csv") == ',');
+
+	// Rows split between chunks, and a quoted field longer than a chunk
+	auto csv_field = [](const std::string& name) {
+		if (name.find_first_of(",\"") == std::string::npos) {
+			return name;
+		}
+		std::string field = "\"";
+		for (char character: name) {
+			field += character == '"' ? "\"\"" : std::string(1, character);
+		}
+		return field + '"';
+	};
+	std::string text = "Employee0\n";
+	std::vector<std::string> names = {"Employee0"};
+	ariel::ChartBuilder expected;
+	expected.add_root("Employee0");
+	for (size_t i = 1; i < 60000; ++i) {
+		std::string manager = names[(i * 2654435761U >> 8U) % i];
+		names.push_back("Employee" + std::to_string(i) + (i % 7 == 0 ? ",\"quoted\"" : ""));
+		text += csv_field(manager) + ',' + csv_field(names.back()) + '\n';
+		expected.add_sub(manager, names.back());
+	}
+	text += "Employee1,\"" + std::string(3 << 20U, 'x') + "\"\n";
+	expected.add_sub("Employee1", std::string(3 << 20U, 'x'));
+	ariel::OrgChart built = expected.build();
+	std::tie(chart, rows) = import(text);
+	CHECK(rows == 60001);
+	CHECK(preorder(chart) == preorder(built));
+
+	const std::string path = "test_chart.csv";
+	{
+		std::ofstream file(path, std::ios::binary);
+		file << text;
+	}
+	ariel::ChartImporter importer;
+	chart = importer.import(path, 2);
+	CHECK(preorder(chart) == preorder(built));
+	CHECK(importer.stats().bytes == text.size());
+	std::remove(path.c_str());
+	CHECK_THROWS_AS(importer.import(path), std::runtime_error);
+
+	CHECK_THROWS_AS(import("CEO\nCEO,CTO,CFO\n"), std::runtime_error);
+	CHECK_THROWS_AS(import("CEO\nCEO,\n"), std::runtime_error);
+	CHECK_THROWS_AS(import("CEO\nCEO,\"CTO\n"), std::runtime_error);
+	CHECK_THROWS_AS(import("CEO\nCEO,\"CTO\"x\n"), std::runtime_error);
+	CHECK_THROWS_AS(import("CEO\nCFO,CTO\n"), std::logic_error);
+	CHECK_THROWS_AS(ariel::ChartImporter('"'), std::invalid_argument);
+	CHECK_THROWS_AS(ariel::ChartImporter(',', false, 0), std::invalid_argument);
+
+	// A byte order mark or a CRLF split between chunks, inside a quoted field or right after
+	// one, is read as if it were whole, and the rows' lines are counted once
+	const std::string split = "\xEF\xBB\xBF\"CEO\"\r\n\"CEO\",\"Two\r\nLines\"\r\n\"CEO\",\"CFO\"\r\n";
+	for (size_t chunk_size = 1; chunk_size <= split.size() + 1; ++chunk_size) {
+		ariel::ChartImporter importer(',', false, chunk_size);
+		std::istringstream input(split);
+		ariel::ChartBuilder builder;
+		importer.read(input, builder);
+		CHECK(preorder(builder.build()) == std::vector<std::string>{"CEO", "Two\r\nLines", "CFO"});
+
+		input = std::istringstream(split + "CFO,CTO,CIO\r\n");
+		std::string error;
+		try {
+			importer.read(input, builder);
+		} catch (const std::runtime_error& malformed) {
+			error = malformed.what();
+		}
+		CHECK(error == "Malformed chart row at line 5: more than two fields");
+	}
+}
+
+TEST_CASE("open_logged_chart_expect_changes_replayed_after_restart_and_compaction") {
+	const std::string path = "test_logged_chart.orgchart";
+	auto remove_files = [&]() {
+		for (const std::string& file: {path, path + ".log", path + ".log.next"}) {
+			std::remove(file.c_str());
+		}
+	};
+	auto preorder = [](ariel::OrgChart chart) {
+		return std::vector<std::string>(chart.begin_preorder(), chart.end_preorder());
+	};
+	auto copy_file = [](const std::string& from, const std::string& to) {
+		std::ifstream input(from, std::ios::binary);
+		std::ofstream output(to, std::ios::binary | std::ios::trunc);
+		output << input.rdbuf();
+	};
+	auto add_levels = [](ariel::OrgChart& chart, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			chart.add_sub("Employee" + std::to_string((i * 2654435761U >> 8U) % i), "Employee" + std::to_string(i));
+		}
+	};
+	remove_files();
+
+	ariel::OrgChart expected;
+	expected.add_root("Employee0");
+	add_levels(expected, 1, 300);
+	{
+		ariel::OrgChart chart = ariel::OrgChart::open(path);
+		CHECK(chart.size() == 0);
+		chart.add_root("Employee0");
+		add_levels(chart, 1, 300);
+		CHECK_THROWS(chart.add_sub("Nobody", "Employee300"));
+		CHECK_NOTHROW(chart.sync());
+
+		// Copies aren't logged
+		ariel::OrgChart copy = chart;
+		copy.add_sub("Employee0", "Copy");
+		CHECK_THROWS_AS(copy.compact(), std::logic_error);
+	}
+	CHECK(preorder(ariel::OrgChart::open(path)) == preorder(expected));
+	CHECK_THROWS_AS(ariel::OrgChart::load(path), std::runtime_error);
+
+	// Folded into a snapshot, in the foreground and then in the background while the chart changes
+	{
+		ariel::OrgChart chart = ariel::OrgChart::open(path);
+		chart.compact(false);
+		CHECK(preorder(ariel::OrgChart::load(path)) == preorder(expected));
+		add_levels(chart, 300, 600);
+		chart.compact();
+		add_levels(chart, 600, 700);
+		chart.add_root("CEO");
+	}
+	add_levels(expected, 300, 700);
+	expected.add_root("CEO");
+	CHECK(preorder(ariel::OrgChart::open(path)) == preorder(expected));
+
+	// A record cut off by a crash is dropped, and the next change is logged after the last whole one
+	{
+		std::ifstream log(path + ".log", std::ios::binary | std::ios::ate);
+		std::string bytes(static_cast<size_t>(log.tellg()), '\0');
+		log.seekg(0);
+		log.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+		std::ofstream cut(path + ".log", std::ios::binary | std::ios::trunc);
+		cut.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 3));
+	}
+	{
+		ariel::OrgChart chart = ariel::OrgChart::open(path);
+		CHECK(*chart.begin_level_order() == "Employee0");
+		chart.add_root("Owner");
+	}
+	expected.add_root("Owner");
+	CHECK(preorder(ariel::OrgChart::open(path)) == preorder(expected));
+
+	// A compaction stopped before the new log replaced the log, with the snapshot saved or not
+	remove_files();
+	{
+		ariel::OrgChart chart = ariel::OrgChart::open(path);
+		chart.add_root("Employee0");
+		add_levels(chart, 1, 300);
+		copy_file(path + ".log", path + ".log.before");
+		chart.compact(false);
+		add_levels(chart, 300, 400);
+	}
+	std::rename((path + ".log").c_str(), (path + ".log.after").c_str());
+	ariel::OrgChart folded;
+	folded.add_root("Employee0");
+	add_levels(folded, 1, 300);
+	ariel::OrgChart stopped = folded.deep_copy();
+	add_levels(stopped, 300, 400);
+	for (int state = 0; state < 3; ++state) {
+		copy_file(path + ".log.before", path + ".log");
+		copy_file(path + ".log.after", path + ".log.next");
+		if (state > 0) {
+			std::fstream next(path + ".log.next", std::ios::binary | std::ios::in | std::ios::out);
+			next.seekp(offsetof(ariel::ChartLog::Header, snapshot));
+			std::uint64_t pending = ariel::ChartLog::PENDING_SNAPSHOT;
+			next.write(reinterpret_cast<const char*>(&pending), sizeof(pending));
+		}
+		if (state == 2) {
+			std::remove(path.c_str());
+		}
+		CHECK(preorder(ariel::OrgChart::open(path)) == preorder(stopped));
+		CHECK(preorder(ariel::OrgChart::open(path)) == preorder(stopped));
+		CHECK(preorder(ariel::OrgChart::load(path)) == preorder(folded));
+	}
+
+	// A chart destroyed in the background while it compacts returns right away, and is
+	// opened again once its log is closed
+	remove_files();
+	ariel::OrgChart::destroy_in_background(true);
+	for (size_t round = 0; round < 3; ++round) {
+		ariel::OrgChart chart = ariel::OrgChart::open(path);
+		if (round == 0) {
+			chart.add_root("Employee0");
+		}
+		add_levels(chart, std::max<size_t>(1, 1000 * round), 1000 * (round + 1));
+		chart.compact();
+		CHECK(chart.headcount("Employee0") == 1000 * (round + 1) - 1);
+	}
+	ariel::OrgChart::destroy_in_background(false);
+	expected = ariel::OrgChart();
+	expected.add_root("Employee0");
+	add_levels(expected, 1, 3000);
+	CHECK(preorder(ariel::OrgChart::open(path)) == preorder(expected));
+	CHECK(preorder(ariel::OrgChart::load(path)) == preorder(expected));
+
+	std::ofstream(path + ".log", std::ios::binary | std::ios::trunc) << "manager,employee\n";
+	CHECK_THROWS_AS(ariel::OrgChart::open(path), std::runtime_error);
+	CHECK_THROWS_AS(ariel::OrgChart().sync(), std::logic_error);
+	remove_files();
+	std::remove((path + ".log.before").c_str());
+	std::remove((path + ".log.after").c_str());
+}
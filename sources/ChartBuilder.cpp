@@ -0,0 +1,273 @@
+#include "ChartBuilder.hpp"
+
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+
+namespace ariel
+{
+	namespace
+	{
+		/**
+		 * @brief Resolve the parents one subordinate at a time, as add_sub would, since a
+		 * 		  parent name shared by several levels refers to the first of them in preorder,
+		 * 		  which the levels added later can change. A subordinate given before any level
+		 * 		  with its parent's name waits until the first one is added.
+		 *
+		 * @param names - The parent and the child name of every subordinate
+		 *
+		 * @param parents - The parent of every node, node i + 1 being subordinate i
+		 *
+		 * @param first_node - The first subordinate in preorder with every name, once done
+		 *
+		 * @throws std::logic_error if some subordinates wait for each other in a cycle
+		 * */
+		void add_in_order(const std::vector<NameId>& names, NameId root_name, std::vector<NodeId>& parents,
+						  std::vector<NodeId>& first_node) {
+			const size_t nodes = parents.size();
+			std::vector<std::uint32_t> depths(nodes, 0);
+			std::vector<NodeId> first_waiting(first_node.size(), NO_NODE);
+			std::vector<NodeId> last_waiting(first_node.size(), NO_NODE);
+			std::vector<NodeId> next_waiting(nodes, NO_NODE);
+			std::vector<NodeId> ready;
+			std::fill(first_node.begin(), first_node.end(), NO_NODE);
+
+			// The children of every node are still added in the order they were given, so their
+			// indices order them as the level order will
+			size_t added = 0;
+			auto add = [&](NodeId node) {
+				NameId parent_name = names[2 * node - 2];
+				NodeId parent = parent_name == root_name ? 0 : first_node[parent_name];
+				parents[node] = parent;
+				depths[node] = depths[parent] + 1;
+				++added;
+
+				NameId name = names[2 * node - 1];
+				NodeId first = first_node[name];
+				if (first == NO_NODE) {
+					for (NodeId waiting = first_waiting[name]; waiting != NO_NODE; waiting = next_waiting[waiting]) {
+						ready.push_back(waiting);
+					}
+					first_node[name] = node;
+				} else if (precedes_in_preorder(node, first, parents, depths)) {
+					first_node[name] = node;
+				}
+			};
+
+			for (NodeId node = 1; node < nodes; ++node) {
+				NameId parent_name = names[2 * node - 2];
+				if (parent_name != root_name && first_node[parent_name] == NO_NODE) {
+					if (first_waiting[parent_name] == NO_NODE) {
+						first_waiting[parent_name] = node;
+					} else {
+						next_waiting[last_waiting[parent_name]] = node;
+					}
+					last_waiting[parent_name] = node;
+					continue;
+				}
+
+				add(node);
+				for (size_t i = 0; i < ready.size(); ++i) {
+					add(ready[i]);
+				}
+				ready.clear();
+			}
+			if (added + 1 != nodes) {
+				throw std::logic_error("Tried to add subordinates that report to each other in a cycle");
+			}
+		}
+	}
+
+	ChartBuilder& ChartBuilder::add_root(std::string_view root) {
+		if (root.empty()) {
+			throw std::invalid_argument("Can't add a root with an empty name");
+		}
+
+		m_root = root;
+		return *this;
+	}
+
+	ChartBuilder& ChartBuilder::add_sub(std::string_view parent, std::string_view child) {
+		if (parent.empty() || child.empty()) {
+			throw std::invalid_argument("Can't add a subordinate with an empty name");
+		}
+
+		m_names += parent;
+		m_name_ends.push_back(m_names.size());
+		m_names += child;
+		m_name_ends.push_back(m_names.size());
+		return *this;
+	}
+
+	void ChartBuilder::reserve(size_t subordinates, size_t name_bytes) {
+		m_names.reserve(name_bytes);
+		m_name_ends.reserve(subordinates * 2);
+	}
+
+	std::string_view ChartBuilder::name(size_t index) const {
+		size_t begin = index == 0 ? 0 : m_name_ends[index - 1];
+		return std::string_view(m_names).substr(begin, m_name_ends[index] - begin);
+	}
+
+	OrgChart ChartBuilder::build(unsigned threads) const {
+		if (m_root.empty()) {
+			throw std::logic_error("Tried to build a chart when there is no root");
+		}
+		if (size() >= NO_NODE) {
+			throw std::length_error("Chart is too large for 32 bit indices");
+		}
+		threads = std::max(threads, 1U);
+
+		// Node 0 is the root and subordinate i is node i + 1, until they're laid out
+		const size_t subordinates = size();
+		const size_t nodes = subordinates + 1;
+
+		// The only hashing pass, spread between the threads, then every name is interned once.
+		// Name 2i is the parent of node i + 1 and name 2i + 1 is its own.
+		std::vector<std::uint32_t> hashes(2 * subordinates);
+		parallel_for(0, hashes.size(), threads, [&](size_t i) {
+			hashes[i] = StringPool::hash(name(i));
+		});
+		StringPool pool;
+		NameId root_name = pool.intern(m_root);
+		std::vector<NameId> names(2 * subordinates);
+		for (size_t i = 0; i < names.size(); ++i) {
+			names[i] = pool.intern(name(i), hashes[i]);
+		}
+		hashes = std::vector<std::uint32_t>();
+
+		// A parent name refers to the root, or else to a subordinate with that name. When no
+		// name is given twice it can only be the first one, and otherwise the parents are
+		// resolved again in order.
+		std::vector<NodeId> first_node(pool.size(), NO_NODE);
+		bool repeated = false;
+		for (size_t i = 0; i < subordinates; ++i) {
+			if (first_node[names[2 * i + 1]] == NO_NODE) {
+				first_node[names[2 * i + 1]] = static_cast<NodeId>(i + 1);
+			} else {
+				repeated = true;
+			}
+		}
+
+		std::vector<NodeId> parents(nodes, NO_NODE);
+		std::atomic<bool> missing_parent(false);
+		parallel_for(1, nodes, threads, [&](size_t node) {
+			NameId parent_name = names[2 * node - 2];
+			NodeId parent = parent_name == root_name ? 0 : first_node[parent_name];
+			if (parent == NO_NODE) {
+				missing_parent.store(true, std::memory_order_relaxed);
+				return;
+			}
+			parents[node] = parent;
+		});
+		if (missing_parent.load()) {
+			throw std::logic_error("Tried to add subordinate to a non-existent parent");
+		}
+		if (repeated) {
+			add_in_order(names, root_name, parents, first_node);
+		}
+
+		std::vector<std::atomic<NodeId>> child_counts(nodes);
+		parallel_for(1, nodes, threads, [&](size_t node) {
+			child_counts[parents[node]].fetch_add(1, std::memory_order_relaxed);
+		});
+
+		// The children of node i are children[child_begin[i], child_begin[i + 1])
+		std::vector<NodeId> child_begin(nodes + 1);
+		parallel_for(0, nodes, threads, [&](size_t node) {
+			child_begin[node] = child_counts[node].load(std::memory_order_relaxed);
+		});
+		child_begin[nodes] = parallel_exclusive_scan(child_begin.data(), nodes, threads);
+
+		// Every child takes the next place of its parent, then every parent's children are put
+		// back in the order they were given, which the threads may have shuffled
+		std::vector<std::atomic<NodeId>>& next_child = child_counts;
+		parallel_for(0, nodes, threads, [&](size_t node) {
+			next_child[node].store(child_begin[node], std::memory_order_relaxed);
+		});
+		std::vector<NodeId> children(subordinates);
+		parallel_for(1, nodes, threads, [&](size_t node) {
+			children[next_child[parents[node]].fetch_add(1, std::memory_order_relaxed)] = static_cast<NodeId>(node);
+		});
+		if (threads > 1) {
+			parallel_for(0, nodes, threads, [&](size_t node) {
+				std::sort(children.begin() + child_begin[node], children.begin() + child_begin[node + 1]);
+			});
+		}
+
+		// Lay the nodes out in level order, a level at a time. The children of a level are
+		// placed by the prefix sums of its child counts.
+		std::vector<NodeId> order(nodes);
+		std::vector<NodeId> new_index(nodes);
+		std::vector<NodeId> level_offsets;
+		order[0] = 0;
+		new_index[0] = 0;
+		for (size_t level_begin = 0, level_end = 1; level_end < nodes;) {
+			const size_t level_size = level_end - level_begin;
+			level_offsets.resize(level_size);
+			parallel_for(0, level_size, threads, [&](size_t i) {
+				NodeId node = order[level_begin + i];
+				level_offsets[i] = child_begin[node + 1] - child_begin[node];
+			});
+			size_t next_level_size = parallel_exclusive_scan(level_offsets.data(), level_size, threads);
+			if (next_level_size == 0) {
+				throw std::logic_error("Tried to add subordinates that report to each other in a cycle");
+			}
+
+			parallel_for(0, level_size, threads, [&](size_t i) {
+				NodeId node = order[level_begin + i];
+				size_t place = level_end + level_offsets[i];
+				for (NodeId child = child_begin[node]; child < child_begin[node + 1]; ++child, ++place) {
+					order[place] = children[child];
+					new_index[children[child]] = static_cast<NodeId>(place);
+				}
+			});
+			level_begin = level_end;
+			level_end += next_level_size;
+		}
+
+		// Fill the node arrays in the new order, as add_child would have linked them
+		FlatTree tree(std::move(pool));
+		tree.m_parent.resize(nodes);
+		tree.m_first_child.resize(nodes);
+		tree.m_last_child.resize(nodes);
+		tree.m_next_sibling.resize(nodes);
+		tree.m_depth.resize(nodes);
+		tree.m_name.resize(nodes);
+		parallel_for(0, nodes, threads, [&](size_t place) {
+			NodeId node = order[place];
+			NodeId child_count = child_begin[node + 1] - child_begin[node];
+			NodeId first_child = child_count == 0 ? NO_NODE : new_index[children[child_begin[node]]];
+			tree.m_parent[place] = place == 0 ? NO_NODE : new_index[parents[node]];
+			tree.m_first_child[place] = first_child;
+			tree.m_last_child[place] = child_count == 0 ? NO_NODE : first_child + child_count - 1;
+			bool last_sibling = place == 0 || place + 1 == nodes || parents[order[place + 1]] != parents[node];
+			tree.m_next_sibling[place] = last_sibling ? NO_NODE : static_cast<NodeId>(place + 1);
+			tree.m_name[place] = place == 0 ? root_name : names[2 * node - 1];
+		});
+
+		// The parents come before their children, so the depths are found by one pass in the
+		// new order
+		tree.m_depth[0] = 0;
+		for (size_t place = 1; place < nodes; ++place) {
+			tree.m_depth[place] = tree.m_depth[tree.m_parent[place]] + 1;
+		}
+
+		// A name stays with the subordinate first in preorder, even if the level order puts
+		// another one with the name before it. The versions are prefixes of the level order,
+		// so a repeated name may have had another first node at them.
+		if (repeated) {
+			tree.index_first_nodes(tree.m_first_node.size());
+		} else {
+			parallel_for(0, tree.m_first_node.size(), threads, [&](size_t name) {
+				tree.m_first_node[name] = first_node[name] == NO_NODE ? NO_NODE : new_index[first_node[name]];
+			});
+			tree.m_previous_first.assign(nodes, NO_NODE);
+		}
+		tree.m_root_names.push_back(FlatTree::RootName{1, root_name});
+		return OrgChart(std::move(tree));
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "OrgChart.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief Builds an OrgChart from a whole list of subordinates at once, instead of one
+	 * 		  add_sub call per subordinate. The subordinates can be given in any order, not
+	 * 		  only after their parents. They're only stored until build, which resolves all
+	 * 		  the names in one hashing pass and lays the nodes out in level order, with the
+	 * 		  children of every level in the order they were given.
+	 *
+	 * 		  Like add_sub, a parent name shared by several levels refers to the root if it's
+	 * 		  named so, and otherwise to the first in preorder of the levels added before the
+	 * 		  subordinate. A subordinate given before any level with its parent's name is
+	 * 		  added right after the first one.
+	 * */
+	class ChartBuilder {
+		public:
+			/**
+			 * @brief Set the root level of the chart, replacing the previous one if there is
+			 *
+			 * @param root - The level that will be the head of the Chart.
+			 * */
+			ChartBuilder& add_root(std::string_view root);
+
+			/**
+			 * @brief Add a child level under a parent level
+			 *
+			 * @param parent - the Parent level under which the child will be placed.
+			 * 				   Doesn't have to be added yet, only by the time the chart is built
+			 *
+			 * @param child - the new child level
+			 * */
+			ChartBuilder& add_sub(std::string_view parent, std::string_view child);
+
+			/**
+			 * @brief Make room for a number of subordinates, and for the bytes of all their names
+			 * */
+			void reserve(size_t subordinates, size_t name_bytes);
+
+			/**
+			 * @brief Get the number of subordinates added to the builder
+			 * */
+			size_t size() const {
+				return m_name_ends.size() / 2;
+			}
+
+			/**
+			 * @brief Build the chart of the root and all the subordinates added so far
+			 *
+			 * @param threads - The number of threads to split the hashing, counting and laying
+			 * 				   out between. Interning the names stays on the calling thread.
+			 *
+			 * @return The chart, its levels laid out in level order
+			 *
+			 * @throws std::logic_error if there's no root, a parent isn't a level of the chart,
+			 * 		   or some subordinates report to each other in a cycle
+			 * */
+			OrgChart build(unsigned threads = 1) const;
+
+		private:
+			/**
+			 * @brief Get the name of a parent (even index) or a child (odd index)
+			 * */
+			std::string_view name(size_t index) const;
+
+			std::string m_root;
+
+			// The parent and the child names of every subordinate, concatenated, and the end
+			// offset of every name
+			std::string m_names;
+			std::vector<size_t> m_name_ends;
+	};
+}
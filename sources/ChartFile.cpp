@@ -0,0 +1,438 @@
+#include "ChartFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ariel
+{
+	namespace {
+		const std::uint64_t CHECKSUM_MULTIPLIER = 0xFF51AFD7ED558CCDULL;
+
+		/**
+		 * @brief A section of the file after the header
+		 * */
+		struct Section {
+			const void* data;
+			size_t size;
+		};
+
+		/**
+		 * @brief Add a section for every chunk of an array's values in [begin, end)
+		 * */
+		template <typename T>
+		void add_sections(std::vector<Section>& sections, const PersistentVector<T>& values, size_t begin, size_t end) {
+			for (size_t chunk = begin / values.CHUNK_SIZE; begin < end; ++chunk) {
+				const size_t offset = begin - chunk * values.CHUNK_SIZE;
+				const size_t count = std::min(values.chunk_size(chunk) - offset, end - begin);
+				sections.push_back(Section{values.chunk(chunk) + offset, count * sizeof(T)});
+				begin += count;
+			}
+		}
+
+		[[noreturn]] void throw_corrupt(const std::string& path) {
+			throw std::runtime_error("Chart file is corrupt: " + path);
+		}
+
+		/**
+		 * @brief Write a file or a directory through to the disk
+		 * */
+		bool sync_path(const std::string& path, int flags) {
+			int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
+			if (file < 0) {
+				return false;
+			}
+			bool synced = ::fsync(file) == 0;
+			return ::close(file) == 0 && synced;
+		}
+	}
+
+	void ChartFile::Checksum::add(const void* data, size_t size) {
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		for (; m_pending_bytes != 0 && size > 0; ++bytes, --size) {
+			m_pending |= std::uint64_t(*bytes) << (8 * m_pending_bytes);
+			if (++m_pending_bytes == 8) {
+				add_word(m_pending);
+				m_pending = 0;
+				m_pending_bytes = 0;
+			}
+		}
+
+		for (; size >= 8; bytes += 8, size -= 8) {
+			std::uint64_t word = 0;
+			for (unsigned byte = 0; byte < 8; ++byte) {
+				word |= std::uint64_t(bytes[byte]) << (8 * byte);
+			}
+			add_word(word);
+		}
+
+		for (; size > 0; ++bytes, --size) {
+			m_pending |= std::uint64_t(*bytes) << (8 * m_pending_bytes++);
+		}
+	}
+
+	std::uint64_t ChartFile::Checksum::value() const {
+		// The bytes of the last word and their count are mixed in last
+		std::uint64_t state = m_state;
+		state = (state ^ m_pending) * CHECKSUM_MULTIPLIER;
+		state = (state ^ m_pending_bytes) * CHECKSUM_MULTIPLIER;
+		return state ^ (state >> 33U);
+	}
+
+	void ChartFile::Checksum::add_word(std::uint64_t word) {
+		m_state = ((m_state ^ word) * CHECKSUM_MULTIPLIER);
+		m_state ^= m_state >> 29U;
+	}
+
+	ChartFile::Layout::Layout(const Header& header) {
+		// The arrays after the names are only there since format 2, the previous first nodes
+		// since format 4
+		const bool arrays = header.format_version >= 2;
+		const std::uint64_t node_array = arrays ? std::uint64_t(header.nodes) * sizeof(NodeId) : 0;
+		const std::uint64_t previous_first_array = header.format_version >= 4 ? node_array : 0;
+		const std::uint64_t name_array = arrays ? std::uint64_t(header.names) * sizeof(NameId) : 0;
+		parents = sizeof(Header);
+		names = parents + std::uint64_t(header.nodes) * sizeof(NodeId);
+		name_offsets = names + std::uint64_t(header.nodes) * sizeof(NameId);
+		name_bytes = name_offsets + (std::uint64_t(header.names) + 1) * sizeof(std::uint32_t);
+		padding = name_bytes + header.name_bytes;
+		hash_probe = arrays ? (padding + 3) / 4 * 4 : padding;
+		first_child = hash_probe + (arrays ? sizeof(std::uint32_t) : 0);
+		last_child = first_child + node_array;
+		next_sibling = last_child + node_array;
+		depth = next_sibling + node_array;
+		first_node = depth + node_array;
+		previous_first = first_node + name_array;
+		name_hashes = previous_first + previous_first_array;
+		slots = name_hashes + name_array;
+		end = slots + std::uint64_t(header.slots) * sizeof(NameId);
+	}
+
+	ChartFile::Layout ChartFile::check_header(const Header& header, std::uint64_t file_size, const std::string& path) {
+		if (file_size < sizeof(Header) || !std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)) {
+			throw std::runtime_error("Not a chart file: " + path);
+		}
+		if (header.format_version == 0 || header.format_version > FORMAT_VERSION) {
+			throw std::runtime_error("Unsupported chart file version: " + path);
+		}
+
+		// The sizes are checked against the file's before anything is allocated or read by them
+		Layout layout(header);
+		if (header.nodes == NO_NODE || header.names == NO_NAME || header.name_bytes > std::numeric_limits<std::uint32_t>::max() ||
+			(header.format_version == 1 && header.slots != 0) || layout.end != file_size) {
+			throw_corrupt(path);
+		}
+		return layout;
+	}
+
+	bool ChartFile::link(FlatTree& tree, NameId names) {
+		const auto nodes = static_cast<NodeId>(tree.m_parent.size());
+		tree.m_first_child.assign(nodes, NO_NODE);
+		tree.m_last_child.assign(nodes, NO_NODE);
+		tree.m_next_sibling.assign(nodes, NO_NODE);
+		tree.m_depth.assign(nodes, 0);
+		for (NodeId node = 0; node < nodes; ++node) {
+			NodeId parent = tree.m_parent[node];
+			NameId name = tree.m_name[node];
+			if (name >= names || (node == 0 ? parent != NO_NODE : parent >= node)) {
+				return false;
+			}
+			if (node == 0) {
+				continue;
+			}
+
+			tree.m_depth[node] = tree.m_depth[parent] + 1;
+			if (tree.m_last_child[parent] == NO_NODE) {
+				tree.m_first_child[parent] = node;
+			} else {
+				tree.m_next_sibling[tree.m_last_child[parent]] = node;
+			}
+			tree.m_last_child[parent] = node;
+		}
+		tree.index_first_nodes(names);
+		return true;
+	}
+
+	bool ChartFile::valid_slots(const StringPool& pool) {
+		const size_t slots = pool.m_slots.size();
+		if (slots < 2 * (pool.size() + 1) || (slots & (slots - 1)) != 0) {
+			return false;
+		}
+
+		// Every name is filed exactly once, where probing from its hash reaches it: no empty
+		// slot between its home slot and its own. A run of filled slots starts after an empty
+		// one, of which there's at least one, so the runs are measured starting from it.
+		const size_t mask = slots - 1;
+		size_t empty = 0;
+		while (empty < slots && pool.m_slots[empty] != NO_NAME) {
+			++empty;
+		}
+		if (empty == slots) {
+			return false;
+		}
+		std::vector<bool> filed(pool.size(), false);
+		size_t run = 0;
+		for (size_t step = 1; step <= slots; ++step) {
+			const size_t slot = (empty + step) & mask;
+			const NameId name = pool.m_slots[slot];
+			if (name == NO_NAME) {
+				run = 0;
+				continue;
+			}
+			if (name >= pool.size() || filed[name] || ((slot - pool.m_hashes[name]) & mask) > run) {
+				return false;
+			}
+			filed[name] = true;
+			++run;
+		}
+		return std::find(filed.begin(), filed.end(), false) == filed.end();
+	}
+
+	void ChartFile::save(const FlatTree& tree, NodeId size, NameId root_name, const std::string& path) {
+		const StringPool& pool = tree.names();
+		Header header{};
+		std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+		header.format_version = FORMAT_VERSION;
+		header.nodes = size;
+		header.names = static_cast<std::uint32_t>(pool.size());
+		header.slots = static_cast<std::uint32_t>(pool.m_slots.size());
+		header.name_bytes = pool.m_bytes.size();
+		const Layout layout(header);
+
+		// An older version links past its last node, so its nodes are linked again by themselves
+		const FlatTree* links = &tree;
+		FlatTree version;
+		if (size < tree.size()) {
+			version.m_parent = tree.m_parent;
+			version.m_parent.resize(size);
+			version.m_name = tree.m_name;
+			version.m_name.resize(size);
+			link(version, header.names);
+			links = &version;
+		}
+
+		// The root's name is the one it had at the version, the rest of the nodes follow it
+		const std::uint32_t hash_probe = StringPool::hash(HASH_PROBE);
+		const char padding[4] = {};
+		std::vector<Section> sections;
+		add_sections(sections, tree.m_parent, 0, size);
+		sections.push_back(Section{&root_name, size == 0 ? 0 : sizeof(NameId)});
+		add_sections(sections, tree.m_name, 1, std::max<size_t>(size, 1));
+		add_sections(sections, pool.m_offsets, 0, pool.m_offsets.size());
+		add_sections(sections, pool.m_bytes, 0, pool.m_bytes.size());
+		sections.push_back(Section{padding, layout.hash_probe - layout.padding});
+		sections.push_back(Section{&hash_probe, sizeof(hash_probe)});
+		add_sections(sections, links->m_first_child, 0, size);
+		add_sections(sections, links->m_last_child, 0, size);
+		add_sections(sections, links->m_next_sibling, 0, size);
+		add_sections(sections, tree.m_depth, 0, size);
+		add_sections(sections, links->m_first_node, 0, links->m_first_node.size());
+		add_sections(sections, links->m_previous_first, 0, size);
+		add_sections(sections, pool.m_hashes, 0, pool.m_hashes.size());
+		add_sections(sections, pool.m_slots, 0, pool.m_slots.size());
+		Checksum checksum;
+		for (const Section& section: sections) {
+			checksum.add(section.data, section.size);
+		}
+		header.checksum = checksum.value();
+
+		const std::string temporary_path = path + ".tmp";
+		{
+			std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+			output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			for (const Section& section: sections) {
+				output.write(static_cast<const char*>(section.data), static_cast<std::streamsize>(section.size));
+			}
+			output.close();
+			if (!output || !sync_path(temporary_path, 0)) {
+				std::remove(temporary_path.c_str());
+				throw std::runtime_error("Can't write chart file: " + path);
+			}
+		}
+
+		// The new file is on the disk before it replaces the old one, so the rename can't be
+		// written before the data it points to
+		if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+			std::remove(temporary_path.c_str());
+			throw std::runtime_error("Can't write chart file: " + path);
+		}
+		if (!sync_directory(path)) {
+			throw std::runtime_error("Can't write chart file: " + path);
+		}
+	}
+
+	bool ChartFile::sync_directory(const std::string& path) {
+		size_t slash = path.rfind('/');
+		if (slash == std::string::npos) {
+			return sync_path(".", O_DIRECTORY);
+		}
+		return sync_path(slash == 0 ? "/" : path.substr(0, slash), O_DIRECTORY);
+	}
+
+	std::uint64_t ChartFile::checksum(const std::string& path) {
+		std::ifstream input(path, std::ios::binary);
+		if (!input) {
+			throw std::runtime_error("Can't open chart file: " + path);
+		}
+
+		Header header{};
+		input.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!input || !std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)) {
+			throw std::runtime_error("Not a chart file: " + path);
+		}
+		return header.checksum;
+	}
+
+	FlatTree ChartFile::load(const std::string& path) {
+		std::ifstream input(path, std::ios::binary | std::ios::ate);
+		if (!input) {
+			throw std::runtime_error("Can't open chart file: " + path);
+		}
+		auto file_size = static_cast<std::uint64_t>(input.tellg());
+		input.seekg(0);
+
+		Header header{};
+		input.read(reinterpret_cast<char*>(&header), sizeof(header));
+		const Layout layout = check_header(header, input ? file_size : 0, path);
+
+		// Every section is read, to be checked, but the links are made again from the parents
+		// and the names are placed again in the pool's chunks
+		FlatTree tree;
+		StringPool& pool = tree.m_names;
+		char padding[4] = {};
+		std::uint32_t hash_probe = 0;
+		std::vector<std::uint32_t> offsets;
+		std::vector<char> bytes;
+		std::vector<NodeId> saved_links;
+		Checksum checksum;
+		auto read = [&](void* values, size_t size) {
+			input.read(static_cast<char*>(values), static_cast<std::streamsize>(size));
+			checksum.add(values, size);
+		};
+		auto read_vector = [&](auto& values, std::uint64_t count) {
+			values.resize(count);
+			read(values.data(), static_cast<size_t>(count * sizeof(values[0])));
+		};
+		auto read_array = [&](auto& values, std::uint64_t count) {
+			values.resize(count);
+			for (size_t chunk = 0; chunk < values.chunk_count(); ++chunk) {
+				read(values.chunk(chunk), values.chunk_size(chunk) * sizeof(values[0]));
+			}
+		};
+		read_array(tree.m_parent, header.nodes);
+		read_array(tree.m_name, header.nodes);
+		read_vector(offsets, std::uint64_t(header.names) + 1);
+		read_vector(bytes, header.name_bytes);
+		if (header.format_version >= 2) {
+			read(padding, layout.hash_probe - layout.padding);
+			read(&hash_probe, sizeof(hash_probe));
+			read_vector(saved_links, (layout.name_hashes - layout.first_child) / sizeof(NodeId));
+			read_array(pool.m_hashes, header.names);
+			read_array(pool.m_slots, header.slots);
+		}
+		if (!input || checksum.value() != header.checksum) {
+			throw_corrupt(path);
+		}
+
+		// A matching checksum doesn't vouch for a file written by something else, so the
+		// indices are checked before they're followed
+		if (offsets[0] != 0 || offsets[header.names] != header.name_bytes || !std::is_sorted(offsets.begin(), offsets.end())) {
+			throw_corrupt(path);
+		}
+		const std::uint32_t terminator = header.format_version >= 5 ? 1 : 0;
+		for (NameId name = 0; name < header.names; ++name) {
+			// Before format 3 a name could cross into the next chunk, and before format 5 it
+			// wasn't followed by a zero byte
+			const std::uint32_t end = offsets[name + 1];
+			const std::uint32_t begin = header.format_version >= 3 ? StringPool::value_begin(offsets[name], end) : offsets[name];
+			if (end - begin < terminator || (terminator != 0 && bytes[end - 1] != '\0')) {
+				throw_corrupt(path);
+			}
+			pool.append_value(std::string_view(bytes.data() + begin, end - begin - terminator));
+		}
+		if (header.format_version < 2 || hash_probe != StringPool::hash(HASH_PROBE) || !valid_slots(pool)) {
+			pool.index_strings();
+		}
+		if (!link(tree, header.names)) {
+			throw_corrupt(path);
+		}
+		if (header.nodes != 0) {
+			tree.m_root_names.push_back(FlatTree::RootName{1, tree.m_name[0]});
+		}
+		return tree;
+	}
+
+	FlatTree ChartFile::map(const std::string& path, bool verify) {
+		int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0) {
+			throw std::runtime_error("Can't open chart file: " + path);
+		}
+		struct stat status {};
+		if (::fstat(file, &status) != 0) {
+			::close(file);
+			throw std::runtime_error("Can't open chart file: " + path);
+		}
+		const auto file_size = static_cast<size_t>(status.st_size);
+		void* address = file_size < sizeof(Header) ? MAP_FAILED : ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		if (address == MAP_FAILED) {
+			throw std::runtime_error(file_size < sizeof(Header) ? "Not a chart file: " + path : "Can't map chart file: " + path);
+		}
+		std::shared_ptr<const void> mapping(address, [file_size](const void* mapped) {
+			::munmap(const_cast<void*>(mapped), file_size);
+		});
+
+		const auto* bytes = static_cast<const char*>(address);
+		const auto& header = *reinterpret_cast<const Header*>(bytes);
+		const Layout layout = check_header(header, file_size, path);
+		if (header.format_version != FORMAT_VERSION) {
+			// An older format doesn't place the names by the pool's chunks, follow them by
+			// zero bytes, or keep the previous first nodes
+			mapping.reset();
+			return load(path);
+		}
+		if (verify) {
+			Checksum checksum;
+			checksum.add(bytes + sizeof(Header), file_size - sizeof(Header));
+			if (checksum.value() != header.checksum) {
+				throw_corrupt(path);
+			}
+		}
+
+		auto section = [bytes](std::uint64_t offset) {
+			return reinterpret_cast<const std::uint32_t*>(bytes + offset);
+		};
+		FlatTree tree;
+		StringPool& pool = tree.m_names;
+		tree.m_parent.map(section(layout.parents), header.nodes, mapping);
+		tree.m_name.map(section(layout.names), header.nodes, mapping);
+		tree.m_first_child.map(section(layout.first_child), header.nodes, mapping);
+		tree.m_last_child.map(section(layout.last_child), header.nodes, mapping);
+		tree.m_next_sibling.map(section(layout.next_sibling), header.nodes, mapping);
+		tree.m_depth.map(section(layout.depth), header.nodes, mapping);
+		tree.m_first_node.map(section(layout.first_node), header.names, mapping);
+		tree.m_previous_first.map(section(layout.previous_first), header.nodes, mapping);
+		pool.m_offsets.map(section(layout.name_offsets), std::uint64_t(header.names) + 1, mapping);
+		pool.m_bytes.map(bytes + layout.name_bytes, header.name_bytes, mapping);
+		pool.m_hashes.map(section(layout.name_hashes), header.names, mapping);
+		pool.m_slots.map(section(layout.slots), header.slots, mapping);
+		if (*section(layout.hash_probe) != StringPool::hash(HASH_PROBE) || (verify && !valid_slots(pool))) {
+			pool.index_strings();
+		}
+		if (header.nodes != 0) {
+			tree.m_root_names.push_back(FlatTree::RootName{1, tree.m_name[0]});
+		}
+		return tree;
+	}
+}
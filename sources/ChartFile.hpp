@@ -0,0 +1,184 @@
+#pragma once
+
+#include "FlatTree.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace ariel {
+	/**
+	 * @brief Saves and loads the nodes of a tree in a binary file, laid out like the tree's
+	 * 		  own arrays so a load is a few large reads and no parsing, and a mapping of the
+	 * 		  file can be read in place:
+	 *
+	 * 		  - A Header
+	 * 		  - The parent of every node, in the order of the nodes (NO_NODE for the root)
+	 * 		  - The name of every node, as an index into the names below
+	 * 		  - The end offset of every distinct name in the name bytes, after a leading 0
+	 * 		  - The bytes of all the distinct names, concatenated. Since format 3, a name that
+	 * 		    would cross a multiple of the pool's chunk size starts at it instead, after
+	 * 		    zero bytes, so the names can be read in place by the chunks. Since format 5,
+	 * 		    every name is followed by a zero byte, which its end offset includes.
+	 *
+	 * 		  Since format 2, followed by the rest of the tree's arrays, starting 4 byte aligned:
+	 *
+	 * 		  - The hash of HASH_PROBE, which the names were hashed by the same function as if
+	 * 		    it matches
+	 * 		  - The first child, last child, next sibling and depth of every node
+	 * 		  - The first non-root node in preorder with every name
+	 * 		  - Since format 4, the node that was the first with every node's name before it,
+	 * 		    or NO_NODE, see FlatTree
+	 * 		  - The hash of every name, and the slots of the names' hash table
+	 *
+	 * 		  The numbers are 32 bit, in the byte order of the machine that saved the file.
+	 * 		  The nodes keep their order, so the children keep theirs, and a repeated name
+	 * 		  still refers to the same node after a load.
+	 * */
+	class ChartFile {
+		public:
+			static constexpr char MAGIC[8] = {'O', 'R', 'G', 'C', 'H', 'A', 'R', 'T'};
+			static constexpr std::uint32_t FORMAT_VERSION = 5;
+			static constexpr const char* HASH_PROBE = "ariel::OrgChart";
+
+			struct Header {
+				char magic[8];
+				std::uint32_t format_version;
+				std::uint32_t nodes;
+				std::uint32_t names;
+
+				// The number of slots of the names' hash table, 0 in format 1
+				std::uint32_t slots;
+				std::uint64_t name_bytes;
+
+				// Of everything after the header, see checksum
+				std::uint64_t checksum;
+			};
+
+			/**
+			 * @brief Save a tree, to a temporary file first which then replaces the file at the
+			 * 		  path, so a failed save never leaves a partial file behind. The file is
+			 * 		  written through to the disk before it replaces the old one, and the
+			 * 		  rename is before save returns, so after a crash the path holds either
+			 * 		  file whole, and the new one once save returned.
+			 *
+			 * @param tree - The tree to save
+			 *
+			 * @param size - The number of nodes the tree had at the version to save, later nodes are ignored
+			 *
+			 * @param root_name - The root's name at that version
+			 *
+			 * @throws std::runtime_error if the file can't be written
+			 * */
+			static void save(const FlatTree& tree, NodeId size, NameId root_name, const std::string& path);
+
+			/**
+			 * @brief Load a tree saved by save in any format, as a tree of a single version with
+			 * 		  all the nodes. The links between the nodes are made again from their parents,
+			 * 		  so they're valid whatever the file holds.
+			 *
+			 * @throws std::runtime_error if the file can't be read, isn't a chart file of a
+			 * 		   known format version, or doesn't match its checksum
+			 * */
+			static FlatTree load(const std::string& path);
+
+			/**
+			 * @brief Map a tree saved by save in the current format into memory, and read its
+			 * 		  arrays in place, in O(1). The tree keeps the file mapped while any of its
+			 * 		  chunks are read from it, and processes mapping the same file share its
+			 * 		  pages. Only the names' hash table is made again, if the file's was hashed
+			 * 		  by another hash function, or is verified and can't be probed. A file of
+			 * 		  an older format is loaded instead.
+			 *
+			 * @param verify - Whether to compare the file with its checksum and check its hash
+			 * 				   table, which reads all of it. Otherwise only its header and size
+			 * 				   are checked, and its contents are trusted.
+			 *
+			 * @throws std::runtime_error if the file can't be mapped, isn't a chart file of a
+			 * 		   known format version, or is verified and doesn't match its checksum
+			 * */
+			static FlatTree map(const std::string& path, bool verify);
+
+			/**
+			 * @brief Get the checksum a file's header records, which tells saved trees apart
+			 * 		  without reading them
+			 *
+			 * @throws std::runtime_error if the file can't be read or isn't a chart file
+			 * */
+			static std::uint64_t checksum(const std::string& path);
+
+			/**
+			 * @brief Write the entries of the directory a path is in through to the disk, so
+			 * 		  a file created or renamed there is still there after a crash
+			 *
+			 * @return Whether the directory was written
+			 * */
+			static bool sync_directory(const std::string& path);
+
+			/**
+			 * @brief A 64 bit checksum of a sequence of bytes, the same however they're split
+			 * 		  between calls to add
+			 * */
+			class Checksum {
+				public:
+					void add(const void* data, size_t size);
+
+					std::uint64_t value() const;
+
+				private:
+					void add_word(std::uint64_t word);
+
+					std::uint64_t m_state = 0x9E3779B97F4A7C15ULL;
+
+					// The bytes of the last word while fewer than 8 were added
+					std::uint64_t m_pending = 0;
+					unsigned m_pending_bytes = 0;
+			};
+
+		private:
+			/**
+			 * @brief The offset of every section of a file in bytes, from the header's counts
+			 * */
+			struct Layout {
+				explicit Layout(const Header& header);
+
+				std::uint64_t parents;
+				std::uint64_t names;
+				std::uint64_t name_offsets;
+				std::uint64_t name_bytes;
+				std::uint64_t padding;
+				std::uint64_t hash_probe;
+				std::uint64_t first_child;
+				std::uint64_t last_child;
+				std::uint64_t next_sibling;
+				std::uint64_t depth;
+				std::uint64_t first_node;
+				std::uint64_t previous_first;
+				std::uint64_t name_hashes;
+				std::uint64_t slots;
+				std::uint64_t end;
+			};
+
+			/**
+			 * @brief Check a file's header and that its size is the one the header describes
+			 * */
+			static Layout check_header(const Header& header, std::uint64_t file_size, const std::string& path);
+
+			/**
+			 * @brief Link the nodes of a tree whose parents and names were placed in bulk, as
+			 * 		  add_child did, and find their depths and the first node in preorder with
+			 * 		  every name, at every version
+			 *
+			 * @param names - The number of names in the tree's pool
+			 *
+			 * @return Whether the parents and the names were valid indices
+			 * */
+			static bool link(FlatTree& tree, NameId names);
+
+			/**
+			 * @brief Check that the slots of a pool's hash table, placed in bulk, can be probed:
+			 * 		  every name is in exactly one slot, reached by probing from its hash, and
+			 * 		  at least one slot is empty
+			 * */
+			static bool valid_slots(const StringPool& pool);
+	};
+}
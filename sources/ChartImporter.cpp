@@ -0,0 +1,237 @@
+#include "ChartImporter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace ariel
+{
+	namespace {
+		const std::string_view BYTE_ORDER_MARK = "\xEF\xBB\xBF";
+
+		/**
+		 * @brief Find a character in [begin, end), end if it isn't there
+		 * */
+		const char* find(const char* begin, const char* end, char character) {
+			const void* found = std::memchr(begin, character, static_cast<size_t>(end - begin));
+			return found == nullptr ? end : static_cast<const char*>(found);
+		}
+
+		bool ends_with(const std::string& text, std::string_view suffix) {
+			return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+		}
+	}
+
+	ChartImporter::ChartImporter(char delimiter, bool header, size_t chunk_size):
+		m_delimiter(delimiter), m_header(header), m_chunk_size(chunk_size) {
+		if (delimiter == '"' || delimiter == '\n' || delimiter == '\r') {
+			throw std::invalid_argument("Can't delimit fields by a quote or a line break");
+		}
+		if (chunk_size == 0) {
+			throw std::invalid_argument("Can't read rows in chunks of 0 bytes");
+		}
+	}
+
+	char ChartImporter::delimiter_of(const std::string& path) {
+		return ends_with(path, ".tsv") || ends_with(path, ".tab") ? '\t' : ',';
+	}
+
+	void ChartImporter::read(std::istream& input, ChartBuilder& builder) {
+		auto start = std::chrono::steady_clock::now();
+		m_stats = Stats();
+		m_line = 1;
+		m_skip_header = m_header;
+		m_buffer.resize(m_chunk_size);
+
+		// The start of the buffer holds the part of a row the last chunk ended in
+		bool first_chunk = true;
+		size_t pending = 0;
+		for (bool last = false; !last;) {
+			input.read(m_buffer.data() + pending, static_cast<std::streamsize>(m_buffer.size() - pending));
+			auto read = static_cast<size_t>(input.gcount());
+			last = !input;
+			m_stats.bytes += read;
+
+			size_t used = pending + read;
+			size_t parsed = 0;
+			std::string_view start(m_buffer.data(), std::min(used, BYTE_ORDER_MARK.size()));
+			if (first_chunk && !last && start.size() < BYTE_ORDER_MARK.size() && BYTE_ORDER_MARK.substr(0, start.size()) == start) {
+				// Too short a chunk to tell if it starts with a byte order mark yet
+			} else {
+				size_t skipped = first_chunk && start == BYTE_ORDER_MARK ? BYTE_ORDER_MARK.size() : 0;
+				first_chunk = false;
+				parsed = skipped + parse_rows(m_buffer.data() + skipped, m_buffer.data() + used, last, builder);
+			}
+			pending = used - parsed;
+			std::memmove(m_buffer.data(), m_buffer.data() + parsed, pending);
+
+			// A row longer than the buffer
+			if (pending == m_buffer.size()) {
+				m_buffer.resize(2 * m_buffer.size());
+			}
+		}
+		if (input.bad()) {
+			throw std::runtime_error("Can't read chart rows");
+		}
+
+		m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void ChartImporter::read(const std::string& path, ChartBuilder& builder) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) {
+			throw std::runtime_error("Can't open chart rows file: " + path);
+		}
+
+		// The names take up most of the file
+		auto size = static_cast<size_t>(file.tellg());
+		file.seekg(0);
+		builder.reserve(builder.size(), size);
+		read(file, builder);
+	}
+
+	OrgChart ChartImporter::import(const std::string& path, unsigned threads) {
+		ChartBuilder builder;
+		read(path, builder);
+		return builder.build(threads);
+	}
+
+	size_t ChartImporter::parse_rows(const char* begin, const char* end, bool last, ChartBuilder& builder) {
+		// The quotes are found a chunk at a time, not a row at a time, since most rows have none
+		const char* row = begin;
+		const char* quote = find(begin, end, '"');
+		while (row < end) {
+			const char* line_end = find(row, end, '\n');
+			if (line_end == end && !last) {
+				break;
+			}
+
+			if (quote < line_end) {
+				const char* next_row = parse_quoted_row(row, end, last, builder);
+				if (next_row == nullptr) {
+					break;
+				}
+				row = next_row;
+				quote = find(row, end, '"');
+				continue;
+			}
+
+			const char* row_end = line_end;
+			if (row_end > row && row_end[-1] == '\r') {
+				--row_end;
+			}
+			const char* delimiter = find(row, row_end, m_delimiter);
+			if (delimiter == row_end) {
+				add_row(std::string_view(), std::string_view(row, static_cast<size_t>(row_end - row)), 1, builder);
+			} else {
+				const char* employee = delimiter + 1;
+				add_row(std::string_view(row, static_cast<size_t>(delimiter - row)),
+					std::string_view(employee, static_cast<size_t>(row_end - employee)),
+					find(employee, row_end, m_delimiter) == row_end ? 2 : 3, builder);
+			}
+			++m_line;
+			row = line_end == end ? end : line_end + 1;
+		}
+		return static_cast<size_t>(row - begin);
+	}
+
+	const char* ChartImporter::parse_quoted_row(const char* row, const char* end, bool last, ChartBuilder& builder) {
+		size_t fields = 0;
+		const char* next = row;
+		while (true) {
+			std::string& field = m_fields[std::min<size_t>(fields, 1)];
+			field.clear();
+			if (next < end && *next == '"') {
+				// Up to the closing quote, a "" is a quote in the field
+				++next;
+				while (true) {
+					const char* quote = find(next, end, '"');
+					// A quote at the end of the text could still be the first of a ""
+					if (!last && (quote == end || quote + 1 == end)) {
+						return nullptr;
+					}
+					if (quote == end) {
+						throw_malformed("unterminated quoted field");
+					}
+					field.append(next, quote);
+					next = quote + 1;
+					if (next == end || *next != '"') {
+						break;
+					}
+					field += '"';
+					++next;
+				}
+			} else {
+				const char* field_end = next;
+				while (field_end < end && *field_end != m_delimiter && *field_end != '\n') {
+					++field_end;
+				}
+				if (field_end == end && !last) {
+					return nullptr;
+				}
+				field.append(next, field_end);
+				next = field_end;
+				if (!field.empty() && field.back() == '\r' && (next == end || *next == '\n')) {
+					field.pop_back();
+				}
+			}
+			++fields;
+
+			if (next < end && *next == m_delimiter) {
+				++next;
+				continue;
+			}
+			if (next < end && *next == '\r' && (next + 1 == end || next[1] == '\n')) {
+				++next;
+			}
+			// Until the line break is read, the row isn't over, and a \r before the end of
+			// the text could be the first half of a \r\n, which is left for the next chunk
+			if (next == end && !last) {
+				return nullptr;
+			}
+			if (next < end && *next != '\n') {
+				throw_malformed("text after a quoted field");
+			}
+			break;
+		}
+
+		// The row's own line breaks are counted too, so the next row's line is right
+		const char* row_end = next == end ? end : next + 1;
+		if (fields == 1) {
+			add_row(std::string_view(), m_fields[0], 1, builder);
+		} else {
+			add_row(m_fields[0], m_fields[1], fields, builder);
+		}
+		m_line += static_cast<size_t>(std::count(row, row_end, '\n')) + (next == end ? 1 : 0);
+		return row_end;
+	}
+
+	void ChartImporter::add_row(std::string_view manager, std::string_view employee, size_t fields, ChartBuilder& builder) {
+		if (fields == 1 && employee.empty()) {
+			return;
+		}
+		if (m_skip_header) {
+			m_skip_header = false;
+			return;
+		}
+		if (fields > 2) {
+			throw_malformed("more than two fields");
+		}
+		if (employee.empty()) {
+			throw_malformed("no employee");
+		}
+
+		if (manager.empty()) {
+			builder.add_root(employee);
+		} else {
+			builder.add_sub(manager, employee);
+		}
+		++m_stats.rows;
+	}
+
+	void ChartImporter::throw_malformed(const char* reason) const {
+		throw std::runtime_error("Malformed chart row at line " + std::to_string(m_line) + ": " + reason);
+	}
+}
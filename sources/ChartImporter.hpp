@@ -0,0 +1,130 @@
+#pragma once
+
+#include "ChartBuilder.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief Imports a chart from "manager,employee" rows of CSV or TSV text, like an HR
+	 * 		  system exports it. The text is read in large chunks and the rows are split in
+	 * 		  place, with memchr finding the line ends and delimiters a word at a time, and
+	 * 		  fed to a ChartBuilder straight from the chunk. The rows can come in any order:
+	 * 		  the builder resolves the managers once all of them are read.
+	 *
+	 * 		  A row with a single field, or with an empty manager, names the root. Fields can
+	 * 		  be quoted as in RFC 4180, with "" for a quote, and hold delimiters and line
+	 * 		  breaks. Empty lines are skipped, and lines can end with \r\n.
+	 * */
+	class ChartImporter {
+		public:
+			/**
+			 * @brief How much an import read, and how long it took
+			 * */
+			struct Stats {
+				size_t rows = 0;
+				size_t bytes = 0;
+				double seconds = 0;
+
+				double rows_per_second() const {
+					return seconds > 0 ? static_cast<double>(rows) / seconds : 0;
+				}
+			};
+
+			/**
+			 * @brief The number of bytes read from the input at a time, by default
+			 * */
+			static constexpr size_t CHUNK_SIZE = size_t(1) << 20U;
+
+			/**
+			 * @brief Create an importer
+			 *
+			 * @param delimiter - The character between the manager and the employee
+			 *
+			 * @param header - Whether the first row names the columns and is skipped
+			 *
+			 * @param chunk_size - The number of bytes to read from the input at a time. A row
+			 * 					   longer than that is still read whole.
+			 *
+			 * @throws std::invalid_argument if the delimiter is a quote or a line break, or the
+			 * 		   chunk size is 0
+			 * */
+			explicit ChartImporter(char delimiter = ',', bool header = false, size_t chunk_size = CHUNK_SIZE);
+
+			/**
+			 * @brief Get the delimiter of a file by its extension: a tab for .tsv and .tab
+			 * 		  files, a comma otherwise
+			 * */
+			static char delimiter_of(const std::string& path);
+
+			/**
+			 * @brief Read all the rows of a stream into a builder
+			 *
+			 * @throws std::runtime_error if a row is malformed or the stream can't be read
+			 * */
+			void read(std::istream& input, ChartBuilder& builder);
+
+			/**
+			 * @brief Read all the rows of a file into a builder, making room for its names
+			 * 		  first
+			 *
+			 * @throws std::runtime_error if the file can't be read or a row is malformed
+			 * */
+			void read(const std::string& path, ChartBuilder& builder);
+
+			/**
+			 * @brief Import the chart of a file, see read and ChartBuilder::build
+			 *
+			 * @param threads - The number of threads to build the chart with
+			 * */
+			OrgChart import(const std::string& path, unsigned threads = 1);
+
+			/**
+			 * @brief Get the stats of the last read
+			 * */
+			const Stats& stats() const {
+				return m_stats;
+			}
+
+		private:
+			/**
+			 * @brief Add the complete rows at the start of some text
+			 *
+			 * @param last - Whether the text is the end of the input, so its last row is
+			 * 				 complete even without a line break
+			 *
+			 * @return The number of bytes of the rows added
+			 * */
+			size_t parse_rows(const char* begin, const char* end, bool last, ChartBuilder& builder);
+
+			/**
+			 * @brief Add a row with quoted fields, unquoting them into m_fields
+			 *
+			 * @return The end of the row after its line break, nullptr if the row isn't
+			 * 		   complete before the end of the text
+			 * */
+			const char* parse_quoted_row(const char* row, const char* end, bool last, ChartBuilder& builder);
+
+			void add_row(std::string_view manager, std::string_view employee, size_t fields, ChartBuilder& builder);
+
+			[[noreturn]] void throw_malformed(const char* reason) const;
+
+			char m_delimiter;
+			bool m_header;
+			size_t m_chunk_size;
+
+			Stats m_stats;
+
+			// The line the next row starts at, and whether the header is still to be skipped
+			size_t m_line = 1;
+			bool m_skip_header = false;
+
+			std::vector<char> m_buffer;
+
+			// The unquoted fields of the last quoted row
+			std::string m_fields[2];
+	};
+}
@@ -0,0 +1,414 @@
+#include "ChartLog.hpp"
+#include "ChartFile.hpp"
+#include "OrgChart.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ariel
+{
+	namespace {
+		// A record's payload size and operation before its payload, and its checksum after it
+		const size_t RECORD_PREFIX_SIZE = sizeof(std::uint32_t) + sizeof(std::uint8_t);
+		const size_t RECORD_OVERHEAD = RECORD_PREFIX_SIZE + sizeof(std::uint32_t);
+
+		bool file_exists(const std::string& path) {
+			struct stat status{};
+			return ::stat(path.c_str(), &status) == 0;
+		}
+
+		[[noreturn]] void throw_write_error(const std::string& path) {
+			throw std::runtime_error("Can't write chart log: " + path);
+		}
+
+		[[noreturn]] void throw_corrupt(const std::string& path) {
+			throw std::runtime_error("Chart log is corrupt: " + path);
+		}
+
+		/**
+		 * @brief Write all the bytes at an offset of a file, retrying short writes
+		 * */
+		bool write_all(int file, const char* data, size_t size, std::uint64_t offset) {
+			while (size > 0) {
+				ssize_t written = ::pwrite(file, data, size, static_cast<off_t>(offset));
+				if (written < 0 && errno == EINTR) {
+					continue;
+				}
+				if (written <= 0) {
+					return false;
+				}
+				data += written;
+				size -= static_cast<size_t>(written);
+				offset += static_cast<std::uint64_t>(written);
+			}
+			return true;
+		}
+
+		std::uint32_t record_checksum(const char* data, size_t size) {
+			ChartFile::Checksum checksum;
+			checksum.add(data, size);
+			return static_cast<std::uint32_t>(checksum.value());
+		}
+
+		template <typename T>
+		void put(std::vector<char>& record, T value) {
+			const auto* bytes = reinterpret_cast<const char*>(&value);
+			record.insert(record.end(), bytes, bytes + sizeof(value));
+		}
+
+		template <typename T>
+		T get(const char* data) {
+			T value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		/**
+		 * @brief The number of detached logs of every chart that aren't destroyed yet
+		 * */
+		struct DetachedLogs {
+			std::mutex mutex;
+			std::condition_variable destroyed;
+			std::map<std::string, size_t> counts;
+		};
+
+		// Never destroyed, since a detached log can be destroyed as the program exits
+		DetachedLogs& detached_logs() {
+			static auto* logs = new DetachedLogs();
+			return *logs;
+		}
+
+		/**
+		 * @brief Read the next name of a record's payload into a string
+		 *
+		 * @return Whether the payload had a whole name left
+		 * */
+		bool get_name(const char*& data, const char* end, std::string& name) {
+			if (static_cast<size_t>(end - data) < sizeof(std::uint32_t)) {
+				return false;
+			}
+			auto size = get<std::uint32_t>(data);
+			data += sizeof(std::uint32_t);
+			if (static_cast<size_t>(end - data) < size) {
+				return false;
+			}
+			name.assign(data, size);
+			data += size;
+			return true;
+		}
+	}
+
+	ChartLog::ChartLog(std::string path, int file, const Replay& replay):
+		m_path(std::move(path)), m_file(file), m_size(replay.size), m_records(replay.records) {}
+
+	ChartLog::~ChartLog() {
+		try {
+			wait_for_compaction();
+		} catch (const std::exception&) {
+			// The compaction is finished when the chart is next opened
+		}
+		::close(m_file);
+
+		if (m_detached) {
+			DetachedLogs& logs = detached_logs();
+			{
+				std::lock_guard<std::mutex> lock(logs.mutex);
+				if (--logs.counts[m_path] == 0) {
+					logs.counts.erase(m_path);
+				}
+			}
+			logs.destroyed.notify_all();
+		}
+	}
+
+	std::unique_ptr<ChartLog> ChartLog::open(const std::string& path, OrgChart& chart) {
+		{
+			DetachedLogs& logs = detached_logs();
+			std::unique_lock<std::mutex> lock(logs.mutex);
+			logs.destroyed.wait(lock, [&]() { return logs.counts.count(path) == 0; });
+		}
+
+		const std::string log_path = path + ".log";
+		const std::string next_path = path + ".log.next";
+		chart = file_exists(path) ? OrgChart::load(path) : OrgChart();
+		const std::uint64_t snapshot = current_snapshot(path);
+
+		if (!file_exists(next_path)) {
+			if (!file_exists(log_path)) {
+				return std::unique_ptr<ChartLog>(new ChartLog(path, create(log_path, snapshot), Replay{sizeof(Header), 0}));
+			}
+			if (snapshot_of(log_path) != snapshot) {
+				throw std::runtime_error("Chart log doesn't continue its snapshot: " + log_path);
+			}
+			Replay replayed = replay(log_path, chart);
+			return std::unique_ptr<ChartLog>(new ChartLog(path, open_for_append(log_path, replayed), replayed));
+		}
+
+		// A compaction was stopped: the log's changes are in the snapshot if it was saved, and
+		// the new log's changes come after them
+		if (file_exists(log_path) && snapshot_of(log_path) == snapshot) {
+			replay(log_path, chart);
+		}
+		std::uint64_t next_snapshot = snapshot_of(next_path);
+		if (next_snapshot != PENDING_SNAPSHOT && next_snapshot != snapshot) {
+			throw std::runtime_error("Chart log doesn't continue its snapshot: " + next_path);
+		}
+		Replay replayed = replay(next_path, chart);
+		int next_file = open_for_append(next_path, replayed);
+		try {
+			finish(path, next_file);
+		} catch (...) {
+			::close(next_file);
+			throw;
+		}
+		return std::unique_ptr<ChartLog>(new ChartLog(path, next_file, replayed));
+	}
+
+	void ChartLog::add_root(std::string_view root) {
+		append(Operation::AddRoot, root, std::string_view());
+	}
+
+	void ChartLog::add_sub(std::string_view parent, std::string_view child) {
+		append(Operation::AddSub, parent, child);
+	}
+
+	void ChartLog::sync() {
+		if (::fdatasync(m_file) != 0) {
+			throw_write_error(m_path + ".log");
+		}
+	}
+
+	void ChartLog::compact(bool background) {
+		wait_for_compaction();
+		if (!m_next) {
+			if (m_records == 0) {
+				return;
+			}
+
+			// The changes from now on go to the new log, so the log is only read from here on.
+			// Its records are on the disk first, since the new log's are replayed after them.
+			if (::fdatasync(m_file) != 0) {
+				throw_write_error(m_path + ".log");
+			}
+			int next_file = create(m_path + ".log.next", PENDING_SNAPSHOT);
+			::close(m_file);
+			m_file = next_file;
+			m_size = sizeof(Header);
+			m_records = 0;
+			m_next = true;
+		}
+
+		// A compaction that failed is done again, without making another new log
+		if (background) {
+			m_compaction = std::async(std::launch::async, finish, m_path, m_file);
+			return;
+		}
+		finish(m_path, m_file);
+		m_next = false;
+	}
+
+	void ChartLog::detach() {
+		if (!m_detached) {
+			DetachedLogs& logs = detached_logs();
+			std::lock_guard<std::mutex> lock(logs.mutex);
+			++logs.counts[m_path];
+			m_detached = true;
+		}
+	}
+
+	void ChartLog::wait_for_compaction() {
+		if (m_compaction.valid()) {
+			m_compaction.get();
+			m_next = false;
+		}
+	}
+
+	std::uint64_t ChartLog::snapshot_of(const std::string& path) {
+		std::ifstream input(path, std::ios::binary);
+		if (!input) {
+			throw std::runtime_error("Can't open chart log: " + path);
+		}
+
+		Header header{};
+		input.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!input || !std::equal(std::begin(MAGIC), std::end(MAGIC), header.magic)) {
+			throw std::runtime_error("Not a chart log: " + path);
+		}
+		if (header.format_version == 0 || header.format_version > FORMAT_VERSION) {
+			throw std::runtime_error("Unsupported chart log version: " + path);
+		}
+		return header.snapshot;
+	}
+
+	std::uint64_t ChartLog::current_snapshot(const std::string& path) {
+		return file_exists(path) ? ChartFile::checksum(path) : NO_SNAPSHOT;
+	}
+
+	ChartLog::Replay ChartLog::replay(const std::string& path, OrgChart& chart) {
+		std::ifstream input(path, std::ios::binary | std::ios::ate);
+		if (!input) {
+			throw std::runtime_error("Can't open chart log: " + path);
+		}
+		auto file_size = static_cast<size_t>(input.tellg());
+		input.seekg(0);
+		std::vector<char> bytes(file_size);
+		input.read(bytes.data(), static_cast<std::streamsize>(file_size));
+		if (!input || file_size < sizeof(Header)) {
+			throw std::runtime_error("Not a chart log: " + path);
+		}
+
+		// The records up to the first one cut off or damaged, which a crash left behind
+		Replay replayed{sizeof(Header), 0};
+		std::string first;
+		std::string second;
+		const char* end = bytes.data() + file_size;
+		for (const char* record = bytes.data() + sizeof(Header); static_cast<size_t>(end - record) >= RECORD_OVERHEAD;) {
+			auto payload_size = get<std::uint32_t>(record);
+			if (static_cast<size_t>(end - record) - RECORD_OVERHEAD < payload_size) {
+				break;
+			}
+			const char* operation = record + sizeof(std::uint32_t);
+			const char* payload = record + RECORD_PREFIX_SIZE;
+			const char* payload_end = payload + payload_size;
+			if (get<std::uint32_t>(payload_end) != record_checksum(operation, payload_size + 1)) {
+				break;
+			}
+
+			try {
+				switch (static_cast<Operation>(*operation)) {
+					case Operation::AddRoot:
+						if (!get_name(payload, payload_end, first) || payload != payload_end) {
+							throw_corrupt(path);
+						}
+						chart.add_root(first);
+						break;
+					case Operation::AddSub:
+						if (!get_name(payload, payload_end, first) || !get_name(payload, payload_end, second) || payload != payload_end) {
+							throw_corrupt(path);
+						}
+						chart.add_sub(first, second);
+						break;
+					default:
+						throw std::runtime_error("Unsupported chart log record: " + path);
+				}
+			} catch (const std::logic_error&) {
+				// A change the chart refuses wasn't made to it when it was logged
+				throw_corrupt(path);
+			}
+
+			record = payload_end + sizeof(std::uint32_t);
+			replayed.size = static_cast<std::uint64_t>(record - bytes.data());
+			++replayed.records;
+		}
+		return replayed;
+	}
+
+	int ChartLog::open_for_append(const std::string& path, const Replay& replay) {
+		int file = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+		if (file < 0) {
+			throw std::runtime_error("Can't open chart log: " + path);
+		}
+		if (::ftruncate(file, static_cast<off_t>(replay.size)) != 0) {
+			::close(file);
+			throw_write_error(path);
+		}
+		return file;
+	}
+
+	int ChartLog::create(const std::string& path, std::uint64_t snapshot) {
+		const std::string temporary_path = path + ".tmp";
+		int file = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (file < 0) {
+			throw_write_error(path);
+		}
+
+		Header header{};
+		std::copy(std::begin(MAGIC), std::end(MAGIC), header.magic);
+		header.format_version = FORMAT_VERSION;
+		header.snapshot = snapshot;
+		if (!write_all(file, reinterpret_cast<const char*>(&header), sizeof(header), 0) || ::fsync(file) != 0 ||
+			std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+			::close(file);
+			std::remove(temporary_path.c_str());
+			throw_write_error(path);
+		}
+		if (!ChartFile::sync_directory(path)) {
+			::close(file);
+			throw_write_error(path);
+		}
+		return file;
+	}
+
+	std::uint64_t ChartLog::fold(const std::string& path) {
+		const std::string log_path = path + ".log";
+		std::uint64_t snapshot = current_snapshot(path);
+		if (!file_exists(log_path) || snapshot_of(log_path) != snapshot) {
+			return snapshot;
+		}
+
+		// Saved through to the disk, along with the rename that makes it the snapshot
+		OrgChart chart = snapshot == NO_SNAPSHOT ? OrgChart() : OrgChart::load(path);
+		replay(log_path, chart);
+		chart.save(path);
+		return ChartFile::checksum(path);
+	}
+
+	void ChartLog::finish(const std::string& path, int next_file) {
+		const std::string next_path = path + ".log.next";
+		std::uint64_t snapshot = fold(path);
+
+		// Once the new log names the snapshot, the old one isn't replayed, and once it's
+		// renamed it's the log. After a crash, every step has to find the ones before it on
+		// the disk, so each is written through before the next one starts:
+		//
+		// - The old log's records, before the new log's (see compact)
+		// - The new snapshot and its rename, before the new log's header names it (see fold)
+		// - The header, before the rename retires the old log
+		// - The rename, before the compaction is done
+		//
+		// Otherwise the disk could hold a log naming a snapshot that didn't make it there, a log
+		// still pending after the rename, or a new log whose records need ones the old log
+		// lost, and the chart couldn't be opened.
+		if (!write_all(next_file, reinterpret_cast<const char*>(&snapshot), sizeof(snapshot), offsetof(Header, snapshot)) ||
+			::fdatasync(next_file) != 0 || std::rename(next_path.c_str(), (path + ".log").c_str()) != 0 ||
+			!ChartFile::sync_directory(path)) {
+			throw_write_error(next_path);
+		}
+	}
+
+	void ChartLog::append(Operation operation, std::string_view first, std::string_view second) {
+		m_record.clear();
+		put(m_record, std::uint32_t(0));
+		put(m_record, static_cast<std::uint8_t>(operation));
+		put(m_record, static_cast<std::uint32_t>(first.size()));
+		m_record.insert(m_record.end(), first.begin(), first.end());
+		if (operation == Operation::AddSub) {
+			put(m_record, static_cast<std::uint32_t>(second.size()));
+			m_record.insert(m_record.end(), second.begin(), second.end());
+		}
+
+		auto payload_size = static_cast<std::uint32_t>(m_record.size() - RECORD_PREFIX_SIZE);
+		std::memcpy(m_record.data(), &payload_size, sizeof(payload_size));
+		put(m_record, record_checksum(m_record.data() + sizeof(std::uint32_t), payload_size + 1));
+
+		// If only part of the record is written, the next one is written over it
+		if (!write_all(m_file, m_record.data(), m_record.size(), m_size)) {
+			throw_write_error(m_path + ".log");
+		}
+		m_size += m_record.size();
+		++m_records;
+	}
+}
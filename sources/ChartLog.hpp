@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+	class OrgChart;
+
+	/**
+	 * @brief Keeps a chart in a snapshot saved by ChartFile and an append-only log of the
+	 * 		  changes made to it since, so writing a change costs as much as the change and
+	 * 		  not the whole chart. The log of the snapshot at path is at path + ".log":
+	 *
+	 * 		  - A Header, with the checksum of the snapshot the log continues
+	 * 		  - One record per change: the size of its payload, its Operation, the payload
+	 * 		    (the length and the bytes of every name the operation takes), and the low 32
+	 * 		    bits of the checksum of the operation and the payload
+	 *
+	 * 		  A record is written to the file as soon as the change is made, so it survives
+	 * 		  the process, and sync writes the records through to the disk. A record cut off
+	 * 		  by a crash fails its checksum, and is dropped with the records after it.
+	 *
+	 * 		  Compacting folds the log into a new snapshot on a background thread, from the
+	 * 		  files alone: the changes made meanwhile go to a new log at path + ".log.next",
+	 * 		  which replaces the log once the snapshot is saved. If the process stops before
+	 * 		  that, opening the chart replays both logs and finishes the compaction. Every
+	 * 		  step is written through to the disk before the next one, see finish, so this
+	 * 		  holds after a crash of the machine too.
+	 * */
+	class ChartLog {
+		public:
+			static constexpr char MAGIC[8] = {'O', 'R', 'G', 'C', 'H', 'L', 'O', 'G'};
+			static constexpr std::uint32_t FORMAT_VERSION = 1;
+
+			// The snapshot of a log that continues no snapshot, the chart was empty
+			static constexpr std::uint64_t NO_SNAPSHOT = 0;
+
+			// The snapshot of a new log while the log before it is being compacted, which is
+			// whatever snapshot the compaction saves
+			static constexpr std::uint64_t PENDING_SNAPSHOT = ~std::uint64_t(0);
+
+			enum class Operation : std::uint8_t {
+				AddRoot = 1,
+				AddSub = 2
+			};
+
+			struct Header {
+				char magic[8];
+				std::uint32_t format_version;
+				std::uint32_t reserved;
+				std::uint64_t snapshot;
+			};
+
+			/**
+			 * @brief Open the chart kept at a path: load its snapshot if there is one, and
+			 * 		  replay the log after it, creating the log if there's none
+			 *
+			 * @param path - The snapshot's path
+			 *
+			 * @param chart - Set to the chart, with the log's changes made to it
+			 *
+			 * @return The log, open to append the chart's next changes to
+			 *
+			 * @throws std::runtime_error if a file can't be read or written, is corrupt, or
+			 * 		   the log doesn't continue the snapshot
+			 * */
+			static std::unique_ptr<ChartLog> open(const std::string& path, OrgChart& chart);
+
+			~ChartLog();
+
+			ChartLog(const ChartLog& other) = delete;
+			ChartLog& operator=(const ChartLog& other) = delete;
+
+			/**
+			 * @brief Append the records of changes made to the chart
+			 *
+			 * @throws std::runtime_error if the record can't be written
+			 * */
+			void add_root(std::string_view root);
+			void add_sub(std::string_view parent, std::string_view child);
+
+			/**
+			 * @brief Write the records appended so far through to the disk
+			 * */
+			void sync();
+
+			/**
+			 * @brief Let the log be destroyed on another thread, where its destructor waits for
+			 * 		  a running compaction. Until the log is destroyed, open waits before it opens
+			 * 		  the same chart again, so the compaction's files are never read half made.
+			 * */
+			void detach();
+
+			/**
+			 * @brief Fold the records appended so far into a new snapshot, waiting for the last
+			 * 		  compaction to finish first. Does nothing if there are none.
+			 *
+			 * @param background - Whether to return right away, while the snapshot is saved
+			 * 					   on a thread of its own
+			 *
+			 * @throws std::runtime_error if the last compaction or this one failed
+			 * */
+			void compact(bool background);
+
+		private:
+			/**
+			 * @brief The records of a log file that were read back
+			 * */
+			struct Replay {
+				// The bytes up to the end of the last whole record, and the number of records
+				std::uint64_t size = 0;
+				size_t records = 0;
+			};
+
+			ChartLog(std::string path, int file, const Replay& replay);
+
+			/**
+			 * @brief Get the checksum of the snapshot a log continues, see Header
+			 *
+			 * @throws std::runtime_error if the file can't be read or isn't a log
+			 * */
+			static std::uint64_t snapshot_of(const std::string& path);
+
+			/**
+			 * @brief Get the checksum of the snapshot at a path, NO_SNAPSHOT if there's none
+			 * */
+			static std::uint64_t current_snapshot(const std::string& path);
+
+			/**
+			 * @brief Make the changes of a log's records to a chart
+			 *
+			 * @throws std::runtime_error if the file isn't a log or a record can't be made
+			 * */
+			static Replay replay(const std::string& path, OrgChart& chart);
+
+			/**
+			 * @brief Open a log to append records after the ones that were read back, cutting
+			 * 		  off what's left of a record a crash cut off
+			 * */
+			static int open_for_append(const std::string& path, const Replay& replay);
+
+			/**
+			 * @brief Create a log with no records, to a temporary file first which then
+			 * 		  replaces the file at the path
+			 *
+			 * @return The log's file, open for appending
+			 * */
+			static int create(const std::string& path, std::uint64_t snapshot);
+
+			/**
+			 * @brief Save the chart of a snapshot and its log as a new snapshot, unless the log
+			 * 		  no longer continues the snapshot since it was folded into it already
+			 *
+			 * @return The checksum of the snapshot the log was folded into
+			 * */
+			static std::uint64_t fold(const std::string& path);
+
+			/**
+			 * @brief Finish a compaction: fold the log into a new snapshot, and make the new
+			 * 		  log, which continues it, the log. Every step can be done again after a
+			 * 		  crash without making a change twice.
+			 *
+			 * @param next_file - The new log's file
+			 * */
+			static void finish(const std::string& path, int next_file);
+
+			void append(Operation operation, std::string_view first, std::string_view second);
+
+			/**
+			 * @brief Wait for the running compaction if there is, and rethrow its error
+			 * */
+			void wait_for_compaction();
+
+			// The snapshot's path
+			std::string m_path;
+
+			// The log appended to, the size of its whole records and their number
+			int m_file;
+			std::uint64_t m_size;
+			size_t m_records;
+
+			// Whether m_file is the new log of a compaction that hasn't finished
+			bool m_next = false;
+
+			// Whether open waits for the log's destructor, see detach
+			bool m_detached = false;
+
+			// The record being written
+			std::vector<char> m_record;
+
+			std::future<void> m_compaction;
+	};
+}
@@ -0,0 +1,204 @@
+#include "ChartWriter.hpp"
+#include "OrgChart.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+namespace ariel
+{
+	namespace {
+		// The index of the format in the streams' iword storage
+		const int FORMAT_INDEX = std::ios_base::xalloc();
+
+		const std::string_view INDENTATION = "                                                                ";
+
+		const std::string_view HEX_DIGITS = "0123456789abcdef";
+
+		// How many nodes ahead the names are fetched into the cache
+		const NodeId PREFETCH_DISTANCE = 16;
+	}
+
+	std::ostream& operator<<(std::ostream& output, ChartFormat format) {
+		output.iword(FORMAT_INDEX) = static_cast<long>(format);
+		return output;
+	}
+
+	ChartFormat chart_format(std::ios_base& stream) {
+		return static_cast<ChartFormat>(stream.iword(FORMAT_INDEX));
+	}
+
+	ChartWriter::ChartWriter(std::ostream& output): m_output(output), m_buffer(BUFFER_SIZE) {}
+
+	ChartWriter::~ChartWriter() {
+		flush();
+	}
+
+	void ChartWriter::flush() {
+		m_output.write(m_buffer.data(), static_cast<std::streamsize>(m_used));
+		m_used = 0;
+	}
+
+	void ChartWriter::put_long(std::string_view text) {
+		flush();
+		if (text.size() > BUFFER_SIZE) {
+			m_output.write(text.data(), static_cast<std::streamsize>(text.size()));
+		} else {
+			put(text);
+		}
+	}
+
+	void ChartWriter::put_number(NodeId number) {
+		char digits[16];
+		auto [end, error] = std::to_chars(digits, digits + sizeof(digits), number);
+		put(std::string_view(digits, static_cast<size_t>(end - digits)));
+	}
+
+	void ChartWriter::put_quoted(std::string_view name) {
+		// Escaped, a character takes up to 6 bytes, so the name is escaped straight into the
+		// buffer as many characters as surely fit at a time
+		put('"');
+		while (!name.empty()) {
+			if (BUFFER_SIZE - m_used < 6) {
+				flush();
+			}
+			size_t count = std::min(name.size(), (BUFFER_SIZE - m_used) / 6);
+			char* output = m_buffer.data() + m_used;
+			for (char character: name.substr(0, count)) {
+				auto byte = static_cast<unsigned char>(character);
+				if (byte >= 0x20 && character != '"' && character != '\\') {
+					*output++ = character;
+				} else if (character == '"' || character == '\\') {
+					*output++ = '\\';
+					*output++ = character;
+				} else if (character == '\n') {
+					*output++ = '\\';
+					*output++ = 'n';
+				} else {
+					output = std::copy_n("\\u00", 4, output);
+					*output++ = HEX_DIGITS[byte >> 4U];
+					*output++ = HEX_DIGITS[byte & 0xFU];
+				}
+			}
+			m_used = static_cast<size_t>(output - m_buffer.data());
+			name.remove_prefix(count);
+		}
+		put('"');
+	}
+
+	void ChartWriter::put_dot_quoted(std::string_view name) {
+		// DOT strings only escape quotes, and backslashes so they aren't read as escapes
+		// themselves, so every other byte is copied as it is, at most 2 bytes a character
+		put('"');
+		while (!name.empty()) {
+			if (BUFFER_SIZE - m_used < 2) {
+				flush();
+			}
+			size_t count = std::min(name.size(), (BUFFER_SIZE - m_used) / 2);
+			char* output = m_buffer.data() + m_used;
+			for (char character: name.substr(0, count)) {
+				if (character == '"' || character == '\\') {
+					*output++ = '\\';
+				}
+				*output++ = character;
+			}
+			m_used = static_cast<size_t>(output - m_buffer.data());
+			name.remove_prefix(count);
+		}
+		put('"');
+	}
+
+	void ChartWriter::write(const FlatTree& tree, NodeId size, NameId root_name, ChartFormat format) {
+		switch (format) {
+			case ChartFormat::Json:
+				write_nodes<ChartFormat::Json>(tree, size, root_name);
+				break;
+			case ChartFormat::Dot:
+				write_dot(tree, size, root_name);
+				break;
+			default:
+				write_nodes<ChartFormat::Indented>(tree, size, root_name);
+				break;
+		}
+	}
+
+	template <ChartFormat format>
+	void ChartWriter::write_nodes(const FlatTree& tree, NodeId size, NameId root_name) {
+		if (size == 0) {
+			put(format == ChartFormat::Json ? "null\n" : "");
+			return;
+		}
+
+		// The names and the depths of the nodes in preorder, scattered to the nodes' preorder
+		// positions in one pass over the nodes rather than gathered by walking the links, so
+		// no read waits on the one before it
+		std::vector<NodeId> positions;
+		std::vector<NodeId> depths;
+		index_subtrees(tree, size, positions, depths);
+		std::vector<NameId> names(size);
+		for (NodeId node = 0; node < size; ++node) {
+			names[positions[node]] = tree.name_id(node);
+			depths[positions[node]] = tree.depth(node);
+		}
+		names[0] = root_name;
+		positions = std::vector<NodeId>();
+
+		const StringPool& pool = tree.names();
+		for (NodeId position = 0; position < size; ++position) {
+			if (position + PREFETCH_DISTANCE < size) {
+				__builtin_prefetch(pool.value(names[position + PREFETCH_DISTANCE]).data());
+			}
+			std::string_view name = pool.value(names[position]);
+			NodeId depth = depths[position];
+
+			// The next node is a child of this one if it's deeper, or else a sibling of this
+			// node or of one above it
+			NodeId next_depth = position + 1 < size ? depths[position + 1] : 0;
+			if constexpr (format == ChartFormat::Indented) {
+				for (size_t indentation = 2 * size_t(depth); indentation > 0;) {
+					size_t run = std::min(indentation, INDENTATION.size());
+					put(INDENTATION.substr(0, run));
+					indentation -= run;
+				}
+				put(name);
+				put('\n');
+			} else {
+				put("{\"name\":");
+				put_quoted(name);
+				if (position + 1 < size && next_depth > depth) {
+					put(",\"subordinates\":[");
+					continue;
+				}
+
+				put('}');
+				NodeId closed = position + 1 < size ? depth - next_depth : depth;
+				for (NodeId level = 0; level < closed; ++level) {
+					put("]}");
+				}
+				put(position + 1 < size ? "," : "\n");
+			}
+		}
+	}
+
+	void ChartWriter::write_dot(const FlatTree& tree, NodeId size, NameId root_name) {
+		// Every node and the edge from its parent, in the order of the nodes
+		put("digraph OrgChart {\n");
+		for (NodeId node = 0; node < size; ++node) {
+			if (node + PREFETCH_DISTANCE < size) {
+				__builtin_prefetch(tree.name(node + PREFETCH_DISTANCE).data());
+			}
+			put("\tn");
+			put_number(node);
+			put(" [label=");
+			put_dot_quoted(node == 0 ? tree.names().value(root_name) : tree.name(node));
+			put("];\n");
+			if (node != 0) {
+				put("\tn");
+				put_number(tree.parent(node));
+				put(" -> n");
+				put_number(node);
+				put(";\n");
+			}
+		}
+		put("}\n");
+	}
+}
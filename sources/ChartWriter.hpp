@@ -0,0 +1,124 @@
+#pragma once
+
+#include "FlatTree.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief The formats an OrgChart can be written in
+	 * */
+	enum class ChartFormat {
+		// Every level on a line of its own, indented by two spaces per level above it
+		Indented,
+
+		// Nested objects: {"name":"CEO","subordinates":[{"name":"CTO"}]}
+		Json,
+
+		// A Graphviz digraph with an edge from every level to each of its subordinates
+		Dot
+	};
+
+	/**
+	 * @brief Set the format the charts written to a stream are written in, Indented by default.
+	 * 		  Like std::hex, it stays set on the stream: std::cout << ChartFormat::Json << chart.
+	 * */
+	std::ostream& operator<<(std::ostream& output, ChartFormat format);
+
+	/**
+	 * @brief Get the format set on a stream
+	 * */
+	ChartFormat chart_format(std::ios_base& stream);
+
+	/**
+	 * @brief Writes the nodes of a tree to a stream. The nodes are formatted into a large buffer
+	 * 		  that is written to the stream only when it fills up, so the stream is called once
+	 * 		  per chunk rather than a few times per node. Nested formats are written from the
+	 * 		  preorder positions and the depths of the nodes, without recursion or a stack.
+	 * */
+	class ChartWriter {
+		public:
+			/**
+			 * @brief Create a writer to a stream, which it's flushed to when it's destroyed
+			 * */
+			explicit ChartWriter(std::ostream& output);
+			~ChartWriter();
+
+			ChartWriter(const ChartWriter& other) = delete;
+			ChartWriter& operator=(const ChartWriter& other) = delete;
+
+			/**
+			 * @brief Write a tree
+			 *
+			 * @param tree - The tree to write
+			 *
+			 * @param size - The number of nodes the tree had at the version to write, later nodes are ignored
+			 *
+			 * @param root_name - The root's name at that version
+			 *
+			 * @param format - The format to write in
+			 * */
+			void write(const FlatTree& tree, NodeId size, NameId root_name, ChartFormat format);
+
+			/**
+			 * @brief Write the buffered output to the stream
+			 * */
+			void flush();
+
+		private:
+			static constexpr size_t BUFFER_SIZE = size_t(1) << 20U;
+
+			/**
+			 * @brief Write the nodes in preorder, in the Indented or Json format
+			 * */
+			template <ChartFormat format>
+			void write_nodes(const FlatTree& tree, NodeId size, NameId root_name);
+
+			/**
+			 * @brief Write the nodes in the Dot format, in the order they were added in
+			 * */
+			void write_dot(const FlatTree& tree, NodeId size, NameId root_name);
+
+			void put(std::string_view text) {
+				if (text.size() > BUFFER_SIZE - m_used) {
+					put_long(text);
+					return;
+				}
+				std::copy(text.begin(), text.end(), m_buffer.data() + m_used);
+				m_used += text.size();
+			}
+
+			void put(char character) {
+				if (m_used == BUFFER_SIZE) {
+					flush();
+				}
+				m_buffer[m_used++] = character;
+			}
+
+			/**
+			 * @brief Same as put, for text that doesn't fit in what's left of the buffer
+			 * */
+			void put_long(std::string_view text);
+
+			void put_number(NodeId number);
+
+			/**
+			 * @brief Put a name between double quotes, escaping the quotes and backslashes in it,
+			 * 		  and the control characters as JSON escapes them
+			 * */
+			void put_quoted(std::string_view name);
+
+			/**
+			 * @brief Put a name between double quotes as a DOT label, escaping only the quotes
+			 * 		  and backslashes in it
+			 * */
+			void put_dot_quoted(std::string_view name);
+
+			std::ostream& m_output;
+			std::vector<char> m_buffer;
+			size_t m_used = 0;
+	};
+}
@@ -0,0 +1,201 @@
+#include "FlatTree.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace ariel
+{
+	FlatTree::FlatTree(StringPool names): m_names(std::move(names)), m_first_node(m_names.size(), NO_NODE) {}
+
+	NodeId FlatTree::add_root(std::string_view name) {
+		NameId root_name = m_names.intern(name);
+		if (m_first_node.size() < m_names.size()) {
+			m_first_node.resize(m_names.size(), NO_NODE);
+		}
+		return add_root(root_name);
+	}
+
+	NodeId FlatTree::add_root(NameId name) {
+		if (empty()) {
+			m_parent.push_back(NO_NODE);
+			m_first_child.push_back(NO_NODE);
+			m_last_child.push_back(NO_NODE);
+			m_next_sibling.push_back(NO_NODE);
+			m_depth.push_back(0);
+			m_name.push_back(name);
+			m_previous_first.push_back(NO_NODE);
+		} else {
+			m_name.set(0, name);
+		}
+		m_root_names.push_back(RootName{version() + 1, name});
+		return 0;
+	}
+
+	NodeId FlatTree::add_child(NodeId parent, std::string_view name) {
+		NameId child_name = m_names.intern(name);
+		if (m_first_node.size() < m_names.size()) {
+			m_first_node.resize(m_names.size(), NO_NODE);
+		}
+		return add_child(parent, child_name);
+	}
+
+	NodeId FlatTree::add_child(NodeId parent, NameId name) {
+		if (size() >= NO_NODE) {
+			throw std::length_error("Tree is too large for 32 bit indices");
+		}
+
+		auto node = static_cast<NodeId>(size());
+		m_parent.push_back(parent);
+		m_first_child.push_back(NO_NODE);
+		m_last_child.push_back(NO_NODE);
+		m_next_sibling.push_back(NO_NODE);
+		m_depth.push_back(m_depth[parent] + 1);
+		m_name.push_back(name);
+
+		// Append to the end of the parent's children list
+		if (m_last_child[parent] == NO_NODE) {
+			m_first_child.set(parent, node);
+		} else {
+			m_next_sibling.set(m_last_child[parent], node);
+		}
+		m_last_child.set(parent, node);
+
+		// The new node is the last in preorder under its parent, but can still come before
+		// the first node with its name, if that's under a later sibling of an ancestor
+		NodeId first = m_first_node[name];
+		if (first == NO_NODE || precedes_in_preorder(node, first, m_parent, m_depth)) {
+			m_first_node.set(name, node);
+			m_previous_first.push_back(first);
+		} else {
+			m_previous_first.push_back(NO_NODE);
+		}
+
+		return node;
+	}
+
+	void FlatTree::reserve(size_t nodes) {
+		m_parent.reserve(nodes);
+		m_first_child.reserve(nodes);
+		m_last_child.reserve(nodes);
+		m_next_sibling.reserve(nodes);
+		m_depth.reserve(nodes);
+		m_name.reserve(nodes);
+		m_previous_first.reserve(nodes);
+	}
+
+	NodeId FlatTree::find_node_by_value(std::string_view value) const {
+		return find_node_by_name(m_names.find(value));
+	}
+
+	NodeId FlatTree::find_node_by_name(NameId name) const {
+		if (empty() || name == NO_NAME) {
+			return NO_NODE;
+		}
+
+		if (m_name[0] == name) {
+			return 0;
+		}
+		return m_first_node[name];
+	}
+
+	NodeId FlatTree::find_node_at(std::string_view value, size_t version) const {
+		NameId name = m_names.find(value);
+		if (version == 0 || name == NO_NAME) {
+			return NO_NODE;
+		}
+		if (name == root_name_at(version)) {
+			return 0;
+		}
+
+		// The nodes that were the first with the name are in the order they were added, so
+		// the version's is the last one added before it
+		NodeId node = m_first_node[name];
+		const size_t size = size_at(version);
+		while (node != NO_NODE && node >= size) {
+			node = m_previous_first[node];
+		}
+		return node;
+	}
+
+	size_t FlatTree::root_names_until(size_t version) const {
+		auto after = std::upper_bound(m_root_names.begin(), m_root_names.end(), version,
+			[](size_t version, const RootName& root_name) { return version < root_name.version; });
+		return static_cast<size_t>(after - m_root_names.begin());
+	}
+
+	size_t FlatTree::size_at(size_t version) const {
+		if (version == 0) {
+			return 0;
+		}
+		return version - root_names_until(version) + 1;
+	}
+
+	NameId FlatTree::root_name_at(size_t version) const {
+		return m_root_names[root_names_until(version) - 1].name;
+	}
+
+	FlatTree FlatTree::copy(unsigned threads) const {
+		FlatTree copy;
+		// The names are the largest, so they're copied first
+		parallel_tasks({
+			[&]() { copy.m_names = m_names.copy(); },
+			[&]() { copy.m_parent = m_parent.copy(); },
+			[&]() { copy.m_first_child = m_first_child.copy(); },
+			[&]() { copy.m_last_child = m_last_child.copy(); },
+			[&]() { copy.m_next_sibling = m_next_sibling.copy(); },
+			[&]() { copy.m_depth = m_depth.copy(); },
+			[&]() { copy.m_name = m_name.copy(); },
+			[&]() { copy.m_first_node = m_first_node.copy(); },
+			[&]() { copy.m_previous_first = m_previous_first.copy(); },
+			[&]() { copy.m_root_names = m_root_names; }}, threads);
+		return copy;
+	}
+
+	void FlatTree::index_first_nodes(size_t names) {
+		m_first_node.assign(names, NO_NODE);
+		m_previous_first.assign(size(), NO_NODE);
+		if (size() < 2) {
+			return;
+		}
+
+		// Number the nodes in preorder: down to the first child, or else to the next sibling of
+		// the node or of the lowest of its ancestors that has one
+		std::vector<NodeId> positions(size());
+		NodeId position = 0;
+		NodeId node = m_first_child[0];
+		while (node != NO_NODE) {
+			positions[node] = ++position;
+			if (m_first_child[node] != NO_NODE) {
+				node = m_first_child[node];
+				continue;
+			}
+			while (node != 0 && m_next_sibling[node] == NO_NODE) {
+				node = m_parent[node];
+			}
+			node = node == 0 ? NO_NODE : m_next_sibling[node];
+		}
+
+		// Then take the nodes in the order they were added, as add_child would have
+		for (node = 1; node < size(); ++node) {
+			NameId name = m_name[node];
+			NodeId first = m_first_node[name];
+			if (first == NO_NODE || positions[node] < positions[first]) {
+				m_previous_first[node] = first;
+				m_first_node[name] = node;
+			}
+		}
+	}
+
+	void FlatTree::clear() {
+		*this = FlatTree();
+	}
+
+	size_t FlatTree::memory_usage(bool unshared) const {
+		return sizeof(*this) - sizeof(m_names) + m_names.memory_usage(unshared) + m_parent.memory_usage(unshared) +
+			m_first_child.memory_usage(unshared) + m_last_child.memory_usage(unshared) +
+			m_next_sibling.memory_usage(unshared) + m_depth.memory_usage(unshared) + m_name.memory_usage(unshared) +
+			m_first_node.memory_usage(unshared) + m_previous_first.memory_usage(unshared) + m_root_names.capacity() * sizeof(RootName);
+	}
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include "PersistentVector.hpp"
+#include "StringPool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief The index of a node in a FlatTree
+	 * */
+	using NodeId = std::uint32_t;
+
+	/**
+	 * @brief A node index that doesn't refer to any node (no parent, no child, etc.)
+	 * */
+	constexpr NodeId NO_NODE = std::numeric_limits<NodeId>::max();
+
+	/**
+	 * @brief Check whether a node comes before another one in preorder, in O(depth), in a
+	 * 		  tree whose siblings are in the order of their indices
+	 *
+	 * @param parents - The parent of every node
+	 *
+	 * @param depths - The depth of every node
+	 * */
+	template <typename Parents, typename Depths>
+	bool precedes_in_preorder(NodeId node, NodeId other, const Parents& parents, const Depths& depths) {
+		if (node == other) {
+			return false;
+		}
+
+		// An ancestor comes before the nodes under it, and otherwise the two come in the order
+		// of their ancestors that are siblings
+		while (depths[node] > depths[other]) {
+			node = parents[node];
+		}
+		if (node == other) {
+			return false;
+		}
+		while (depths[other] > depths[node]) {
+			other = parents[other];
+		}
+		if (other == node) {
+			return true;
+		}
+		while (parents[node] != parents[other]) {
+			node = parents[node];
+			other = parents[other];
+		}
+		return node < other;
+	}
+
+	/**
+	 * @brief The node storage of an OrgChart, kept as a structure of arrays.
+	 * 		  Every node is a 32 bit index into the arrays below, its children are
+	 * 		  linked through first-child/next-sibling indices, and its name is a handle
+	 * 		  into a StringPool shared by all the nodes. Nodes are only ever appended,
+	 * 		  node 0 is the root.
+	 *
+	 * 		  The arrays are PersistentVectors, so a copy of the tree shares them, and an
+	 * 		  edit of the copy only copies the chunks it writes: the new node's, its parent's
+	 * 		  and its previous sibling's, and their names'.
+	 *
+	 * 		  Every add_root and add_child makes a new version of the tree. Since the nodes
+	 * 		  are appended and children link forward to higher indices, the tree at an older
+	 * 		  version is a prefix of the nodes, with every link past it ignored. Only the
+	 * 		  name of the root has to be kept for every version, and which node was the
+	 * 		  first with its name before every node that became the first.
+	 * */
+	class FlatTree {
+		public:
+			FlatTree() = default;
+
+			/**
+			 * @brief Create a tree without nodes, whose names are already interned, so its
+			 * 		  nodes can be added by their handles
+			 * */
+			explicit FlatTree(StringPool names);
+
+			/**
+			 * @brief Set the root of the tree, renaming it if it already exists
+			 *
+			 * @return The index of the root
+			 * */
+			NodeId add_root(std::string_view name);
+
+			/**
+			 * @brief Same as add_root, by the handle of a name already in the tree's pool
+			 * */
+			NodeId add_root(NameId name);
+
+			/**
+			 * @brief Append a new node as the last child of an existing node
+			 *
+			 * @param parent - The index of the parent, must be an existing node
+			 *
+			 * @param name - The name of the new node
+			 *
+			 * @return The index of the new node
+			 * */
+			NodeId add_child(NodeId parent, std::string_view name);
+
+			/**
+			 * @brief Same as add_child, by the handle of a name already in the tree's pool
+			 * */
+			NodeId add_child(NodeId parent, NameId name);
+
+			/**
+			 * @brief Make room for a number of nodes, so adding them doesn't reallocate
+			 * */
+			void reserve(size_t nodes);
+
+			/**
+			 * @brief Find a node in the tree by its name. If several nodes share the name,
+			 * 		  the first one in preorder, as a search from the root finds it.
+			 *
+			 * @return The index of the required node, NO_NODE if doesn't exist
+			 * */
+			NodeId find_node_by_value(std::string_view value) const;
+
+			/**
+			 * @brief Find a node in the tree by its interned name, same as find_node_by_value
+			 * */
+			NodeId find_node_by_name(NameId name) const;
+
+			/**
+			 * @brief Find a node in the tree as it was at an older version, same as
+			 * 		  find_node_by_value otherwise. O(1) unless nodes added since then came
+			 * 		  before the version's first in preorder, then O(number of such nodes).
+			 * */
+			NodeId find_node_at(std::string_view value, size_t version) const;
+
+			/**
+			 * @brief Get the number of modifications of the tree so far, 0 while it's empty
+			 * */
+			size_t version() const {
+				return m_root_names.empty() ? 0 : size() - 1 + m_root_names.size();
+			}
+
+			/**
+			 * @brief Get the number of nodes the tree had at an older version
+			 * */
+			size_t size_at(size_t version) const;
+
+			/**
+			 * @brief Get the name the root had at an older version, which mustn't be 0
+			 * */
+			NameId root_name_at(size_t version) const;
+
+			/**
+			 * @brief Copy the tree into arrays of its own, which no other tree shares, copying
+			 * 		  them on up to a number of threads at once. A plain copy shares them.
+			 * */
+			FlatTree copy(unsigned threads) const;
+
+			/**
+			 * @brief Remove all the nodes from the tree
+			 * */
+			void clear();
+
+			/**
+			 * @brief Get the number of bytes held by the tree, including unused capacity
+			 *
+			 * @param unshared - Whether to count only what no copy of the tree shares
+			 * */
+			size_t memory_usage(bool unshared = false) const;
+
+			size_t size() const {
+				return m_parent.size();
+			}
+
+			bool empty() const {
+				return m_parent.empty();
+			}
+
+			NodeId parent(NodeId node) const {
+				return m_parent[node];
+			}
+
+			NodeId first_child(NodeId node) const {
+				return m_first_child[node];
+			}
+
+			NodeId next_sibling(NodeId node) const {
+				return m_next_sibling[node];
+			}
+
+			std::uint32_t depth(NodeId node) const {
+				return m_depth[node];
+			}
+
+			NameId name_id(NodeId node) const {
+				return m_name[node];
+			}
+
+			std::string_view name(NodeId node) const {
+				return m_names.value(m_name[node]);
+			}
+
+			const StringPool& names() const {
+				return m_names;
+			}
+
+		private:
+			// Lay the nodes out in bulk
+			friend class ChartBuilder;
+			friend class ChartFile;
+
+			PersistentVector<NodeId> m_parent;
+			PersistentVector<NodeId> m_first_child;
+			PersistentVector<NodeId> m_last_child;
+			PersistentVector<NodeId> m_next_sibling;
+			PersistentVector<std::uint32_t> m_depth;
+
+			PersistentVector<NameId> m_name;
+
+			StringPool m_names;
+
+			// The first non-root node in preorder with every name, the root is matched
+			// separately so renaming it never invalidates the index
+			PersistentVector<NodeId> m_first_node;
+
+			// The node that was the first with the node's name before it, for every node that
+			// became the first when it was added, NO_NODE for the rest. Following them from
+			// m_first_node finds the first node at an older version.
+			PersistentVector<NodeId> m_previous_first;
+
+			/**
+			 * @brief A name given to the root, and the version of the tree since which it has it
+			 * */
+			struct RootName {
+				size_t version;
+				NameId name;
+			};
+
+			std::vector<RootName> m_root_names;
+
+			/**
+			 * @brief Get the number of times the root was named up to a version, every other
+			 * 		  modification added a node
+			 * */
+			size_t root_names_until(size_t version) const;
+
+			/**
+			 * @brief Find the first non-root node in preorder with every name, and the ones
+			 * 		  it was at the older versions, by walking the tree once, for nodes that
+			 * 		  were linked in bulk
+			 *
+			 * @param names - The number of names the nodes can have
+			 * */
+			void index_first_nodes(size_t names);
+	};
+}
@@ -0,0 +1,72 @@
+#include "ManagerIndex.hpp"
+
+#include <algorithm>
+
+namespace ariel
+{
+	namespace {
+		// The index of the highest set bit
+		size_t floor_log2(size_t value) {
+			size_t log = 0;
+			while (value >>= 1U) {
+				++log;
+			}
+			return log;
+		}
+	}
+
+	void ManagerIndex::build(const FlatTree& tree, NodeId size, const std::vector<NodeId>& entry) {
+		m_keys.assign(size, 0);
+		for (NodeId node = 0; node < size; ++node) {
+			m_keys[entry[node]] = static_cast<std::uint64_t>(tree.depth(node)) << 32U | tree.parent(node);
+		}
+
+		m_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		m_block_table.resize(m_blocks);
+		for (size_t block = 0; block < m_blocks; ++block) {
+			auto begin = static_cast<NodeId>(block * BLOCK_SIZE);
+			m_block_table[block] = scan(begin, std::min<NodeId>(begin + BLOCK_SIZE, size));
+		}
+
+		size_t rows = m_blocks == 0 ? 0 : floor_log2(m_blocks) + 1;
+		m_block_table.resize(rows * m_blocks);
+		for (size_t row = 1; row < rows; ++row) {
+			const std::uint64_t* previous = &m_block_table[(row - 1) * m_blocks];
+			std::uint64_t* current = &m_block_table[row * m_blocks];
+			size_t half = size_t(1) << (row - 1);
+			for (size_t block = 0; block + 2 * half <= m_blocks; ++block) {
+				current[block] = std::min(previous[block], previous[block + half]);
+			}
+		}
+	}
+
+	NodeId ManagerIndex::common_manager(NodeId first, NodeId second) const {
+		if (second < first) {
+			std::swap(first, second);
+		}
+
+		// The range is (first, second]
+		NodeId begin = first + 1;
+		NodeId end = second + 1;
+		size_t begin_block = (begin + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		size_t end_block = end / BLOCK_SIZE;
+		if (begin_block >= end_block) {
+			return static_cast<NodeId>(scan(begin, end));
+		}
+
+		std::uint64_t key = std::min(scan(begin, static_cast<NodeId>(begin_block * BLOCK_SIZE)),
+			scan(static_cast<NodeId>(end_block * BLOCK_SIZE), end));
+		size_t row = floor_log2(end_block - begin_block);
+		const std::uint64_t* blocks = &m_block_table[row * m_blocks];
+		key = std::min({key, blocks[begin_block], blocks[end_block - (size_t(1) << row)]});
+		return static_cast<NodeId>(key);
+	}
+
+	std::uint64_t ManagerIndex::scan(NodeId begin, NodeId end) const {
+		std::uint64_t key = UINT64_MAX;
+		for (NodeId position = begin; position < end; ++position) {
+			key = std::min(key, m_keys[position]);
+		}
+		return key;
+	}
+}
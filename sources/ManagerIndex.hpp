@@ -0,0 +1,51 @@
+#pragma once
+
+#include "FlatTree.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief An index of the lowest common manager of every two nodes of a tree, by their
+	 * 		  preorder positions. For two nodes at positions first < second, it's the parent of
+	 * 		  the shallowest node at the positions (first, second], so the index keeps the depth
+	 * 		  and the parent of the node at every position, and answers range minimum queries
+	 * 		  over them: the positions are split into blocks of BLOCK_SIZE, a sparse table over
+	 * 		  the blocks answers the whole blocks of a range in O(1), and the ends are scanned.
+	 * 		  It takes about 8 bytes per node.
+	 * */
+	class ManagerIndex {
+		public:
+			/**
+			 * @brief Index a tree
+			 *
+			 * @param tree - The tree to index
+			 *
+			 * @param size - The number of nodes the tree had at the version to index
+			 *
+			 * @param entry - The preorder position of every node, see index_subtrees
+			 * */
+			void build(const FlatTree& tree, NodeId size, const std::vector<NodeId>& entry);
+
+			/**
+			 * @brief Get the lowest common manager of the nodes at two different preorder positions
+			 * */
+			NodeId common_manager(NodeId first, NodeId second) const;
+
+		private:
+			static constexpr NodeId BLOCK_SIZE = 32;
+
+			/**
+			 * @brief Get the smallest key at the positions [begin, end)
+			 * */
+			std::uint64_t scan(NodeId begin, NodeId end) const;
+
+			// The depth of the node at every position in the high half, and its parent in the low one
+			std::vector<std::uint64_t> m_keys;
+
+			// Row j holds the smallest key of every 2^j blocks from each block, row after row
+			std::vector<std::uint64_t> m_block_table;
+			size_t m_blocks = 0;
+	};
+}
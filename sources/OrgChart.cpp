@@ -1,341 +1,639 @@
 #include "OrgChart.hpp"
+#include "ChartFile.hpp"
+#include "Parallel.hpp"
+
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 namespace ariel
 {
-	void delete_all_nodes_in_tree(Tree* root) {
-		if (root != nullptr) {
-			for (auto* child: root->children) {
-				delete_all_nodes_in_tree(child);
+	namespace {
+		std::atomic<bool> background_destruction(false);
+
+		/**
+		 * @brief A thread that drops the references it's handed, so whatever they were the
+		 * 		  last reference to is freed off the thread that handed them over
+		 * */
+		class BackgroundReleaser {
+			public:
+				BackgroundReleaser(): m_thread([this]() { run(); }) {}
+
+				BackgroundReleaser(const BackgroundReleaser&) = delete;
+
+				BackgroundReleaser& operator=(const BackgroundReleaser&) = delete;
+
+				// Releases what's still queued, and from now on charts are released in the
+				// foreground, since the static releaser is gone before some static charts
+				~BackgroundReleaser() {
+					background_destruction = false;
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_stopping = true;
+					}
+					m_ready.notify_one();
+					m_thread.join();
+				}
+
+				void release(std::shared_ptr<void> garbage) {
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_garbage.push_back(std::move(garbage));
+					}
+					m_ready.notify_one();
+				}
+
+			private:
+				void run() {
+					std::unique_lock<std::mutex> lock(m_mutex);
+					while (true) {
+						m_ready.wait(lock, [this]() { return m_stopping || !m_garbage.empty(); });
+						if (m_garbage.empty()) {
+							return;
+						}
+
+						std::deque<std::shared_ptr<void>> garbage;
+						garbage.swap(m_garbage);
+						lock.unlock();
+						garbage.clear();
+						lock.lock();
+					}
+				}
+
+				std::mutex m_mutex;
+				std::condition_variable m_ready;
+				std::deque<std::shared_ptr<void>> m_garbage;
+				bool m_stopping = false;
+
+				std::thread m_thread;
+		};
+
+		BackgroundReleaser& background_releaser() {
+			static BackgroundReleaser releaser;
+			return releaser;
+		}
+	}
+
+	void list_level_order(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order) {
+		order.clear();
+		order.push_back(root);
+
+		// The buffer itself is the BFS queue
+		for (size_t next = 0; next < order.size(); ++next) {
+			// No link is a node past the size of the tree once NO_NODE is
+			for (NodeId child = tree.first_child(order[next]); child < size; child = tree.next_sibling(child)) {
+				order.push_back(child);
 			}
-			delete root;
 		}
 	}
 
-	Tree* copy_tree(Tree* src_root) {
-		Tree* new_root = nullptr;
-		if (src_root != nullptr) {
-			new_root = new Tree;
-
-			new_root->value = src_root->value;
+	void list_reverse_level_order(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order) {
+		list_level_order(tree, root, size, order);
 
-			for (auto *child: src_root->children) {
-				new_root->children.push_back(copy_tree(child));
+		// Reversing the whole order puts the deepest level first, then reversing every
+		// level on its own puts its nodes back from left to right
+		std::reverse(order.begin(), order.end());
+		for (auto level_begin = order.begin(); level_begin != order.end();) {
+			auto level_end = level_begin;
+			std::uint32_t depth = tree.depth(*level_begin);
+			while (level_end != order.end() && tree.depth(*level_end) == depth) {
+				++level_end;
 			}
+			std::reverse(level_begin, level_end);
+			level_begin = level_end;
 		}
-		return new_root;
 	}
 
-	void map_tree_nodes(Tree* root, std::vector<std::pair<size_t, Tree*>>& node_depth_table, size_t curr_depth) {
-		if (root != nullptr) {
-			node_depth_table.push_back(std::pair<size_t, Tree*>(curr_depth++, root));
+	void list_preorder(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order) {
+		order.clear();
+
+		NodeId node = root;
+		while (node != NO_NODE) {
+			order.push_back(node);
 
-			for (auto* child: root->children) {
-				map_tree_nodes(child, node_depth_table, curr_depth);
+			// Go down to the first child if there is one
+			NodeId next = tree.first_child(node);
+
+			// Otherwise climb up until a node with a next sibling is found
+			for (; next >= size && node != root; node = tree.parent(node)) {
+				next = tree.next_sibling(node);
 			}
+			node = next < size ? next : NO_NODE;
 		}
 	}
 
-	bool compare_heights(std::pair<size_t, Tree*> elem1, std::pair<size_t, Tree*> elem2) {
-		// Prefer to go to the last one added
-		if (elem1.first == elem2.first) {
-			return true;
+	void index_subtrees(const FlatTree& tree, NodeId size, std::vector<NodeId>& entry, std::vector<NodeId>& exit) {
+		// Sum up the subtree sizes into exit first
+		exit.clear();
+		count_subtrees(tree, size, exit);
+		entry.resize(size);
+		if (size == 0) {
+			return;
 		}
-		return elem1.first < elem2.first;
-	}
 
-	void queue_tree_nodes_preorder(Tree* root, std::queue<Tree*>& queue) {
-		if (root != nullptr) {
-			queue.push(root);
-			
-			for (auto* child: root->children) {
-				queue_tree_nodes_preorder(child, queue);
+		// Every node's children follow it in preorder one subtree after the other
+		entry[0] = 0;
+		for (NodeId node = 0; node < size; ++node) {
+			NodeId position = entry[node] + 1;
+			for (NodeId child = tree.first_child(node); child < size; child = tree.next_sibling(child)) {
+				entry[child] = position;
+				position += exit[child];
 			}
+			exit[node] += entry[node];
 		}
 	}
 
-	OrgChart::LevelOrderIterator::LevelOrderIterator(Tree* node): m_node(node) {}
-
-	OrgChart::LevelOrderIterator::LevelOrderIterator(const LevelOrderIterator& other):
-		m_node(other.m_node), m_iteration_queue(other.m_iteration_queue) {}
-
-	OrgChart::LevelOrderIterator& OrgChart::LevelOrderIterator::operator=(const LevelOrderIterator& other) {
-		if (this == &other) {
-			return *this;
+	void count_subtrees(const FlatTree& tree, NodeId size, std::vector<NodeId>& counts) {
+		const auto counted = static_cast<NodeId>(counts.size());
+		size_t walk_length = 0;
+		for (NodeId node = counted; node < size && walk_length <= size; ++node) {
+			walk_length += tree.depth(node);
 		}
 
-		m_node = other.m_node;
-		return *this;
-	}
-
-	OrgChart::LevelOrderIterator::LevelOrderIterator(LevelOrderIterator&& other) noexcept: m_node(other.m_node) {
-		other.m_node = nullptr;
-		m_iteration_queue = std::move(other.m_iteration_queue);
+		counts.resize(size, 1);
+		if (walk_length <= size) {
+			for (NodeId node = counted; node < size; ++node) {
+				for (NodeId above = tree.parent(node); above != NO_NODE; above = tree.parent(above)) {
+					++counts[above];
+				}
+			}
+		} else {
+			// A node's children come after it, so a backward pass sums them up before it's added to
+			std::fill(counts.begin(), counts.end(), 1);
+			for (NodeId node = size - 1; node > 0; --node) {
+				counts[tree.parent(node)] += counts[node];
+			}
+		}
 	}
 
-	OrgChart::LevelOrderIterator& OrgChart::LevelOrderIterator::operator=(LevelOrderIterator&& other) noexcept {
-		if (this == &other) {
-			return *this;
-		}
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>::OrderIterator(): m_names(nullptr), m_size(0), m_position(0) {}
 
-		m_node = other.m_node;
-		other.m_node = nullptr;
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>::OrderIterator(const Rank* names, size_t size, size_t position):
+		m_names(names), m_size(size), m_position(position) {}
 
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>& OrgChart::OrderIterator<order>::operator++() {
+		++m_position;
 		return *this;
 	}
 
-	OrgChart::LevelOrderIterator& OrgChart::LevelOrderIterator::operator++() {
-		for (auto* child: m_node->children) {
-			// Push all of my children's children into the queue
-			m_iteration_queue.push(child);
-		}
-
-		if (m_iteration_queue.empty()) {
-			m_node = nullptr;
-			return *this;
-		}
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order> OrgChart::OrderIterator<order>::operator++(int) {
+		OrderIterator previous = *this;
+		++m_position;
+		return previous;
+	}
 
-		m_node = m_iteration_queue.front();
-		m_iteration_queue.pop();
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>& OrgChart::OrderIterator<order>::operator--() {
+		--m_position;
 		return *this;
 	}
 
-	bool OrgChart::LevelOrderIterator::operator==(const OrgChart::LevelOrderIterator& other) const {
-		if (m_node == nullptr) {
-			return other.m_node == nullptr;
-		}
-		return other.m_node != nullptr && m_node->value == other.m_node->value;
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order> OrgChart::OrderIterator<order>::operator--(int) {
+		OrderIterator previous = *this;
+		--m_position;
+		return previous;
 	}
 
-	bool OrgChart::LevelOrderIterator::operator!=(const OrgChart::LevelOrderIterator& other) const {
-		return !(*this == other);
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>& OrgChart::OrderIterator<order>::operator+=(difference_type offset) {
+		m_position = static_cast<size_t>(static_cast<difference_type>(m_position) + offset);
+		return *this;
 	}
 
-	std::string& OrgChart::LevelOrderIterator::operator*() {
-		return m_node->value;
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order>& OrgChart::OrderIterator<order>::operator-=(difference_type offset) {
+		return *this += -offset;
 	}
 
-	std::string* OrgChart::LevelOrderIterator::operator->() {
-		return &m_node->value;
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order> OrgChart::OrderIterator<order>::operator+(difference_type offset) const {
+		OrderIterator result = *this;
+		return result += offset;
 	}
 
-	OrgChart::ReverseOrderIterator& OrgChart::ReverseOrderIterator::operator++() {
-		if (m_iteration_vector.empty()) {
-			m_node = nullptr;
-			return *this;
-		}
-
-		m_node = m_iteration_vector.back().second;
-		m_iteration_vector.pop_back();
-		return *this;
+	template <TraversalOrder order>
+	OrgChart::OrderIterator<order> OrgChart::OrderIterator<order>::operator-(difference_type offset) const {
+		OrderIterator result = *this;
+		return result -= offset;
 	}
 
-	bool OrgChart::ReverseOrderIterator::operator==(const OrgChart::ReverseOrderIterator& other) const {
-		if (m_node == nullptr) {
-			return other.m_node == nullptr;
-		}
-		return other.m_node != nullptr && m_node->value == other.m_node->value;
+	template <TraversalOrder order>
+	typename OrgChart::OrderIterator<order>::difference_type OrgChart::OrderIterator<order>::operator-(const OrderIterator& other) const {
+		return static_cast<difference_type>(m_position) - static_cast<difference_type>(other.m_position);
 	}
 
-	bool OrgChart::ReverseOrderIterator::operator!=(const OrgChart::ReverseOrderIterator& other) const {
-		return !(*this == other);
+	template <TraversalOrder order>
+	const OrgChart::Rank& OrgChart::OrderIterator<order>::operator[](difference_type offset) const {
+		return *(*this + offset);
 	}
 
-	std::string& OrgChart::ReverseOrderIterator::operator*() {
-		return m_node->value;
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator<(const OrderIterator& other) const {
+		return m_position < other.m_position;
 	}
 
-	std::string* OrgChart::ReverseOrderIterator::operator->() {
-		return &m_node->value;
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator>(const OrderIterator& other) const {
+		return other < *this;
 	}
 
-	OrgChart::PreorderIterator& OrgChart::PreorderIterator::operator++() {
-		if (m_iteration_queue.empty()) {
-			m_node = nullptr;
-			return *this;
-		}
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator<=(const OrderIterator& other) const {
+		return !(other < *this);
+	}
 
-		m_node = m_iteration_queue.front();
-		m_iteration_queue.pop();
-		return *this;
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator>=(const OrderIterator& other) const {
+		return !(*this < other);
 	}
 
-	bool OrgChart::PreorderIterator::operator==(const OrgChart::PreorderIterator& other) const {
-		if (m_node == nullptr) {
-			return other.m_node == nullptr;
-		}
-		return other.m_node != nullptr && m_node->value == other.m_node->value;
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator==(const OrgChart::OrderIterator<order>& other) const {
+		// Two iterators are the same when they're at the same position of the same order,
+		// the end is simply the position past the last rank
+		return m_position == other.m_position && m_names == other.m_names;
 	}
 
-	bool OrgChart::PreorderIterator::operator!=(const OrgChart::PreorderIterator& other) const {
+	template <TraversalOrder order>
+	bool OrgChart::OrderIterator<order>::operator!=(const OrgChart::OrderIterator<order>& other) const {
 		return !(*this == other);
 	}
 
-	std::string& OrgChart::PreorderIterator::operator*() {
-		return m_node->value;
+	template <TraversalOrder order>
+	const OrgChart::Rank& OrgChart::OrderIterator<order>::operator*() const {
+		return m_names[m_position];
 	}
 
-	std::string* OrgChart::PreorderIterator::operator->() {
-		return &m_node->value;
+	template <TraversalOrder order>
+	const OrgChart::Rank* OrgChart::OrderIterator<order>::operator->() const {
+		return m_names + m_position;
 	}
 
-	OrgChart::ReverseOrderIterator::ReverseOrderIterator(Tree* node): m_node(node) {
-		if (node != nullptr) {
-			map_tree_nodes(node, m_iteration_vector, 0);
+	template class OrgChart::OrderIterator<TraversalOrder::level>;
+	template class OrgChart::OrderIterator<TraversalOrder::reverse_level>;
+	template class OrgChart::OrderIterator<TraversalOrder::preorder>;
 
-			std::sort(m_iteration_vector.begin(), m_iteration_vector.end(), compare_heights);
-			
-			m_node = m_iteration_vector.back().second;
-			m_iteration_vector.pop_back();
+	OrgChart::~OrgChart() {
+		if ((m_tree || m_log) && background_destruction) {
+			// Everything the chart holds that grows with it, and its log, which waits for a
+			// running compaction when it's destroyed
+			struct Remains {
+				std::shared_ptr<FlatTree> tree;
+				TraversalCache caches[6];
+				std::vector<NodeId> listed_nodes;
+				SubtreeIndex subtree_index;
+				CommonManagerIndex manager_index;
+				std::vector<NodeId> headcounts;
+				std::unique_ptr<ChartLog> log;
+			};
+			if (m_log) {
+				m_log->detach();
+			}
+			background_releaser().release(std::make_shared<Remains>(Remains{std::move(m_tree),
+				{std::move(m_level_order), std::move(m_reverse_order), std::move(m_preorder),
+					std::move(m_subtree_level_order), std::move(m_subtree_reverse_order), std::move(m_subtree_preorder)},
+				std::move(m_listed_nodes), std::move(m_subtree_index), std::move(m_manager_index),
+				std::move(m_headcounts), std::move(m_log)}));
 		}
 	}
 
-	OrgChart::ReverseOrderIterator::ReverseOrderIterator(const ReverseOrderIterator& other): m_node(other.m_node) {}
+	void OrgChart::destroy_in_background(bool enabled) {
+		if (enabled) {
+			// Start the thread now, so it's released after every chart that can use it
+			background_releaser();
+		}
+		background_destruction = enabled;
+	}
 
-	OrgChart::ReverseOrderIterator& OrgChart::ReverseOrderIterator::operator=(const ReverseOrderIterator& other) {
+	OrgChart::OrgChart() = default;
+
+	OrgChart::OrgChart(FlatTree tree):
+		m_tree(std::make_shared<FlatTree>(std::move(tree))) {}
+
+	// The copy shares the nodes, and then the chunks either chart didn't modify. The traversal
+	// caches can be listed again at any time, so a copy starts without them.
+	OrgChart::OrgChart(const OrgChart& other):
+		m_tree(other.m_tree), m_version(other.m_version), m_epoch(other.m_epoch) {}
+
+	OrgChart& OrgChart::operator=(const OrgChart& other) {
 		if (this == &other) {
 			return *this;
 		}
-		m_node = other.m_node;
+
+		m_tree = other.m_tree;
+		m_version = other.m_version;
+		++m_epoch;
+		m_headcounts.clear();
+		m_log.reset();
 		return *this;
 	}
 
-	OrgChart::ReverseOrderIterator::ReverseOrderIterator(ReverseOrderIterator&& other) noexcept: m_node(other.m_node) {
-		other.m_node = nullptr;
+	OrgChart::OrgChart(OrgChart&& other) noexcept:
+		m_tree(std::move(other.m_tree)), m_version(other.m_version),
+		m_epoch(other.m_epoch), m_level_order(std::move(other.m_level_order)),
+		m_reverse_order(std::move(other.m_reverse_order)), m_preorder(std::move(other.m_preorder)),
+		m_subtree_level_order(std::move(other.m_subtree_level_order)),
+		m_subtree_reverse_order(std::move(other.m_subtree_reverse_order)), m_subtree_preorder(std::move(other.m_subtree_preorder)),
+		m_subtree_index(std::move(other.m_subtree_index)), m_manager_index(std::move(other.m_manager_index)),
+		m_headcounts(std::move(other.m_headcounts)), m_log(std::move(other.m_log)) {
+		other.m_version = LATEST_VERSION;
+		++other.m_epoch;
+		other.m_headcounts.clear();
 	}
 
-	OrgChart::ReverseOrderIterator& OrgChart::ReverseOrderIterator::operator=(ReverseOrderIterator&& other) noexcept {
+	OrgChart& OrgChart::operator=(OrgChart&& other) noexcept {
 		if (this == &other) {
 			return *this;
 		}
 
-		m_node = other.m_node;
-		other.m_node = nullptr;
+		m_tree = std::move(other.m_tree);
+		m_version = other.m_version;
+		m_epoch = other.m_epoch;
+		m_level_order = std::move(other.m_level_order);
+		m_reverse_order = std::move(other.m_reverse_order);
+		m_preorder = std::move(other.m_preorder);
+		m_subtree_level_order = std::move(other.m_subtree_level_order);
+		m_subtree_reverse_order = std::move(other.m_subtree_reverse_order);
+		m_subtree_preorder = std::move(other.m_subtree_preorder);
+		m_subtree_index = std::move(other.m_subtree_index);
+		m_manager_index = std::move(other.m_manager_index);
+		m_headcounts = std::move(other.m_headcounts);
+		m_log = std::move(other.m_log);
+		other.m_version = LATEST_VERSION;
+		++other.m_epoch;
+		other.m_headcounts.clear();
 		return *this;
 	}
 
+	OrgChart& OrgChart::add_root(const std::string& new_root) {
+		if (m_version != LATEST_VERSION) {
+			throw std::logic_error("Can't modify a read only chart");
+		}
 
-	OrgChart::PreorderIterator::PreorderIterator(Tree* node): m_node(node) {
-		if (node != nullptr) {
-			queue_tree_nodes_preorder(node, m_iteration_queue);
+		if (new_root.empty()) {
+			throw std::invalid_argument("Can't add a root with an empty name");
+		}
 
-			// The root has already been set as the current node
-			m_iteration_queue.pop();
+		writable_tree().add_root(new_root);
+		++m_epoch;
+		if (m_log) {
+			m_log->add_root(new_root);
 		}
+		return *this;
 	}
 
-	OrgChart::PreorderIterator::PreorderIterator(const PreorderIterator& other): m_node(other.m_node) {}
+	OrgChart& OrgChart::add_sub(const std::string& parent, const std::string& child) {
+		if (m_version != LATEST_VERSION) {
+			throw std::logic_error("Can't modify a read only chart");
+		}
 
-	OrgChart::PreorderIterator& OrgChart::PreorderIterator::operator=(const PreorderIterator& other) {
-		if (this == &other) {
-			return *this;
+		if (tree().empty()) {
+			// Throw an exception
+			throw std::logic_error("Tried to add subordinate to chart when there is no root");
+		}
+
+		if (child.empty()) {
+			throw std::invalid_argument("Can't add a subordinate with an empty name");
+		}
+
+		NodeId new_child_parent = find_node(parent);
+
+		if (new_child_parent == NO_NODE) {
+			// Throw an exception
+			throw std::logic_error("Tried to add subordinate to a non-existent parent");
 		}
 
-		m_node = other.m_node;
+		writable_tree().add_child(new_child_parent, child);
+		++m_epoch;
+		if (m_log) {
+			m_log->add_sub(parent, child);
+		}
 		return *this;
 	}
 
-	OrgChart::PreorderIterator::PreorderIterator(PreorderIterator&& other) noexcept: m_node(other.m_node) {
-		other.m_node = nullptr;
+	size_t OrgChart::size() const {
+		if (!m_tree) {
+			return 0;
+		}
+		return m_version == LATEST_VERSION ? m_tree->size() : m_tree->size_at(m_version);
 	}
 
-	OrgChart::PreorderIterator& OrgChart::PreorderIterator::operator=(PreorderIterator&& other) noexcept {
-		if (this == &other) {
-			return *this;
+	size_t OrgChart::version() const {
+		return m_version == LATEST_VERSION ? tree().version() : m_version;
+	}
+
+	OrgChart OrgChart::at_version(size_t version) const {
+		if (version > this->version()) {
+			throw std::out_of_range("Chart has no such version");
 		}
 
-		m_node = other.m_node;
-		other.m_node = nullptr;
-		return *this;
+		// The version shares the tree, so the chart's next modification copies it away, along
+		// with the chunks it writes
+		OrgChart chart;
+		chart.m_tree = m_tree;
+		chart.m_version = version;
+		return chart;
 	}
 
-	OrgChart::~OrgChart() {
-		delete_all_nodes_in_tree(m_root);
+	OrgChart OrgChart::deep_copy(unsigned threads) const {
+		OrgChart copy;
+		if (m_tree) {
+			copy.m_tree = std::make_shared<FlatTree>(m_tree->copy(threads));
+		}
+		copy.m_version = m_version;
+		return copy;
 	}
 
-	OrgChart::OrgChart(): m_root(nullptr) {}
+	const FlatTree& OrgChart::tree() const {
+		static const FlatTree empty_tree;
+		return m_tree ? *m_tree : empty_tree;
+	}
 
-	OrgChart::OrgChart(const OrgChart& other): m_root(copy_tree(other.m_root)) {}
+	FlatTree& OrgChart::writable_tree() {
+		if (!m_tree) {
+			m_tree = std::make_shared<FlatTree>();
+		} else if (m_tree.use_count() > 1) {
+			m_tree = std::make_shared<FlatTree>(*m_tree);
+		} else {
+			// The last other owner may have just released the nodes on another thread, its reads
+			// must happen before they're modified here
+			std::atomic_thread_fence(std::memory_order_acquire);
+		}
+		return *m_tree;
+	}
 
-	OrgChart& OrgChart::operator=(const OrgChart& other) {
-		if (this == &other) {
-			return *this;
+	const std::vector<OrgChart::Rank>* OrgChart::cached_order(TraversalCache& cache,
+		void (*list_order)(const FlatTree&, NodeId, NodeId, std::vector<NodeId>&), NodeId root) {
+		const FlatTree& nodes = tree();
+		if (cache.epoch != m_epoch || cache.root != root || cache.nodes_version != nodes.version()) {
+			size_t version = this->version();
+			cache.names.clear();
+			if (version != 0) {
+				// The nodes are listed and then replaced by their names, which are all the
+				// iterators need. The root's name is the one it had at the chart's version.
+				list_order(nodes, root, static_cast<NodeId>(nodes.size_at(version)), m_listed_nodes);
+				const StringPool& pool = nodes.names();
+				NameId root_name = nodes.root_name_at(version);
+				cache.names.reserve(m_listed_nodes.size());
+				for (NodeId node: m_listed_nodes) {
+					cache.names.emplace_back(pool.value(node == 0 ? root_name : nodes.name_id(node)));
+				}
+			}
+			cache.epoch = m_epoch;
+			cache.root = root;
+			cache.nodes_version = nodes.version();
 		}
+		return &cache.names;
+	}
 
-		m_root = copy_tree(other.m_root);
-		return *this;
+	const std::vector<OrgChart::Rank>* OrgChart::cached_order(TraversalCache& cache,
+		void (*list_order)(const FlatTree&, NodeId, NodeId, std::vector<NodeId>&), const std::string& level) {
+		return cached_order(cache, list_order, find_existing_node(level));
 	}
 
-	OrgChart::OrgChart(OrgChart&& other) noexcept: m_root(other.m_root) {
-		other.m_root = nullptr;
+	const OrgChart::SubtreeIndex& OrgChart::subtree_index() {
+		if (m_subtree_index.epoch != m_epoch) {
+			index_subtrees(tree(), static_cast<NodeId>(size()), m_subtree_index.entry, m_subtree_index.exit);
+			m_subtree_index.epoch = m_epoch;
+		}
+		return m_subtree_index;
 	}
 
-	OrgChart& OrgChart::operator=(OrgChart&& other) noexcept {
-		if (this == &other) {
-			return *this;
+	const ManagerIndex& OrgChart::manager_index() {
+		if (m_manager_index.epoch != m_epoch) {
+			m_manager_index.managers.build(tree(), static_cast<NodeId>(size()), subtree_index().entry);
+			m_manager_index.epoch = m_epoch;
 		}
+		return m_manager_index.managers;
+	}
 
-		m_root = other.m_root;
-		other.m_root = nullptr;
-		return *this;
+	std::string_view OrgChart::node_name(NodeId node) const {
+		const FlatTree& nodes = tree();
+		return node == 0 ? nodes.names().value(nodes.root_name_at(version())) : nodes.name(node);
 	}
 
-	OrgChart& OrgChart::add_root(const std::string& new_root) {
-		if (m_root != nullptr) {
-			m_root->value = new_root;
-			return *this;
+	NodeId OrgChart::find_existing_node(std::string_view level) const {
+		NodeId node = find_node(level);
+		if (node == NO_NODE) {
+			throw std::logic_error("Tried to find a non-existent level");
 		}
+		return node;
+	}
 
-		m_root = new Tree;
-		m_root->value = new_root;
-		return *this;
+	bool OrgChart::is_under(const std::string& level, const std::string& manager) {
+		NodeId node = find_existing_node(level);
+		NodeId manager_node = find_existing_node(manager);
+		const SubtreeIndex& index = subtree_index();
+		return index.entry[manager_node] < index.entry[node] && index.entry[node] < index.exit[manager_node];
 	}
 
-	Tree* find_node_by_value(Tree* root_node, const std::string& value) {
-		if (root_node == nullptr) {
-			return nullptr;
-		}
-		
-		// If this is the correct node, return it!
-		if (root_node->value == value) {
-			return root_node;
+	std::string_view OrgChart::common_manager(const std::string& first, const std::string& second) {
+		NodeId first_node = find_existing_node(first);
+		NodeId second_node = find_existing_node(second);
+		const ManagerIndex& managers = manager_index();
+		const std::vector<NodeId>& entry = m_subtree_index.entry;
+		return node_name(first_node == second_node ? first_node : managers.common_manager(entry[first_node], entry[second_node]));
+	}
+
+	std::vector<std::string_view> OrgChart::common_managers(const std::vector<std::pair<std::string, std::string>>& pairs,
+		unsigned threads) {
+		// Every level is found before any query, so a missing one throws before the threads start
+		std::vector<NodeId> nodes(2 * pairs.size());
+		for (size_t i = 0; i < pairs.size(); ++i) {
+			nodes[2 * i] = find_existing_node(pairs[i].first);
+			nodes[2 * i + 1] = find_existing_node(pairs[i].second);
 		}
 
-		Tree* child_res = nullptr;
-		// Go over the children of the current node
-		for (Tree* child: root_node->children) {
-			child_res = find_node_by_value(child, value);
+		const ManagerIndex& managers = manager_index();
+		const std::vector<NodeId>& entry = m_subtree_index.entry;
+		std::vector<std::string_view> result(pairs.size());
+		parallel_for(0, pairs.size(), std::max(threads, 1U), [&](size_t i) {
+			NodeId first_node = nodes[2 * i];
+			NodeId second_node = nodes[2 * i + 1];
+			result[i] = node_name(first_node == second_node ? first_node : managers.common_manager(entry[first_node], entry[second_node]));
+		});
+		return result;
+	}
 
-			// If the required node was found under your child, return it
-			if (child_res != nullptr) {
-				return child_res;
-			}
-		}
+	size_t OrgChart::headcount(const std::string& level) {
+		NodeId node = find_existing_node(level);
+		count_subtrees(tree(), static_cast<NodeId>(size()), m_headcounts);
+		return m_headcounts[node] - 1;
+	}
 
-		return nullptr;
+	size_t OrgChart::depth(const std::string& level) const {
+		return tree().depth(find_existing_node(level));
 	}
 
-	OrgChart& OrgChart::add_sub(const std::string& parent, const std::string& child) {
-		if (m_root == nullptr) {
-			// Throw an exception
-			throw std::logic_error("Tried to add subordinate to chart when there is no root");
+	NodeId OrgChart::find_node(std::string_view level) const {
+		return m_version == LATEST_VERSION ? tree().find_node_by_value(level) : tree().find_node_at(level, m_version);
+	}
+
+	void OrgChart::save(const std::string& path) const {
+		const FlatTree& nodes = tree();
+		size_t version = this->version();
+		ChartFile::save(nodes, static_cast<NodeId>(size()), version == 0 ? NO_NAME : nodes.root_name_at(version), path);
+	}
+
+	OrgChart OrgChart::load(const std::string& path) {
+		FlatTree tree = ChartFile::load(path);
+		if (tree.empty()) {
+			return OrgChart();
 		}
+		return OrgChart(std::move(tree));
+	}
 
-		Tree* new_child_parent = find_node_by_value(m_root, parent);
+	OrgChart OrgChart::map(const std::string& path, bool verify) {
+		FlatTree tree = ChartFile::map(path, verify);
+		if (tree.empty()) {
+			return OrgChart();
+		}
 
-		if (new_child_parent == nullptr) {
-			// Throw an exception
-			throw std::logic_error("Tried to add subordinate to a non-existent parent");
+		// At a version of its own, like a chart returned by at_version
+		OrgChart chart;
+		chart.m_version = tree.version();
+		chart.m_tree = std::make_shared<FlatTree>(std::move(tree));
+		return chart;
+	}
+
+	OrgChart OrgChart::open(const std::string& path) {
+		OrgChart chart;
+		chart.m_log = ChartLog::open(path, chart);
+		return chart;
+	}
+
+	void OrgChart::sync() {
+		if (!m_log) {
+			throw std::logic_error("Chart has no log, it wasn't opened by open");
 		}
+		m_log->sync();
+	}
 
-		Tree* new_child = new Tree;
-		new_child->value = child;
+	void OrgChart::compact(bool background) {
+		if (!m_log) {
+			throw std::logic_error("Chart has no log, it wasn't opened by open");
+		}
+		m_log->compact(background);
+	}
 
-		new_child_parent->children.push_back(new_child);
-		return *this;
+	void OrgChart::write(std::ostream& output, ChartFormat format) const {
+		const FlatTree& nodes = tree();
+		size_t version = this->version();
+		ChartWriter writer(output);
+		writer.write(nodes, static_cast<NodeId>(size()), version == 0 ? NO_NAME : nodes.root_name_at(version), format);
 	}
 
 	std::ostream& operator<<(std::ostream& output, const OrgChart& me) {
+		me.write(output, chart_format(output));
 		return output;
 	}
 
@@ -346,46 +644,106 @@ namespace ariel
 	OrgChart::LevelOrderIterator OrgChart::end() {
 		return end_level_order();
 	}
-	
+
 	OrgChart::LevelOrderIterator OrgChart::begin_level_order() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::LevelOrderIterator(m_root);
+		const std::vector<Rank>* names = cached_order(m_level_order, list_level_order);
+		return OrgChart::LevelOrderIterator(names->data(), names->size());
 	}
 
 	OrgChart::LevelOrderIterator OrgChart::end_level_order() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::LevelOrderIterator(nullptr);
+		const std::vector<Rank>* names = cached_order(m_level_order, list_level_order);
+		return OrgChart::LevelOrderIterator(names->data(), names->size(), names->size());
 	}
 
 	OrgChart::ReverseOrderIterator OrgChart::begin_reverse_order() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::ReverseOrderIterator(m_root);
+		const std::vector<Rank>* names = cached_order(m_reverse_order, list_reverse_level_order);
+		return OrgChart::ReverseOrderIterator(names->data(), names->size());
 	}
 
 	OrgChart::ReverseOrderIterator OrgChart::reverse_order() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::ReverseOrderIterator(nullptr);
+		const std::vector<Rank>* names = cached_order(m_reverse_order, list_reverse_level_order);
+		return OrgChart::ReverseOrderIterator(names->data(), names->size(), names->size());
 	}
 
 	OrgChart::PreorderIterator OrgChart::begin_preorder() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::PreorderIterator(m_root);
+		const std::vector<Rank>* names = cached_order(m_preorder, list_preorder);
+		return OrgChart::PreorderIterator(names->data(), names->size());
 	}
 
 	OrgChart::PreorderIterator OrgChart::end_preorder() {
-		if (m_root == nullptr) {
+		if (size() == 0) {
 			throw std::logic_error("Can't get iterator of empty chart");
 		}
-		return OrgChart::PreorderIterator(nullptr);
+		const std::vector<Rank>* names = cached_order(m_preorder, list_preorder);
+		return OrgChart::PreorderIterator(names->data(), names->size(), names->size());
+	}
+
+	OrgChart::LevelOrderView OrgChart::level_order() {
+		return LevelOrderView(cached_order(m_level_order, list_level_order));
+	}
+
+	OrgChart::ReverseOrderView OrgChart::reverse_level_order() {
+		return ReverseOrderView(cached_order(m_reverse_order, list_reverse_level_order));
+	}
+
+	OrgChart::PreorderView OrgChart::preorder() {
+		return PreorderView(cached_order(m_preorder, list_preorder));
+	}
+
+	OrgChart::LevelOrderIterator OrgChart::begin_level_order(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_level_order, list_level_order, level);
+		return OrgChart::LevelOrderIterator(names->data(), names->size());
+	}
+
+	OrgChart::LevelOrderIterator OrgChart::end_level_order(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_level_order, list_level_order, level);
+		return OrgChart::LevelOrderIterator(names->data(), names->size(), names->size());
+	}
+
+	OrgChart::ReverseOrderIterator OrgChart::begin_reverse_order(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_reverse_order, list_reverse_level_order, level);
+		return OrgChart::ReverseOrderIterator(names->data(), names->size());
+	}
+
+	OrgChart::ReverseOrderIterator OrgChart::reverse_order(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_reverse_order, list_reverse_level_order, level);
+		return OrgChart::ReverseOrderIterator(names->data(), names->size(), names->size());
+	}
+
+	OrgChart::PreorderIterator OrgChart::begin_preorder(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_preorder, list_preorder, level);
+		return OrgChart::PreorderIterator(names->data(), names->size());
+	}
+
+	OrgChart::PreorderIterator OrgChart::end_preorder(const std::string& level) {
+		const std::vector<Rank>* names = cached_order(m_subtree_preorder, list_preorder, level);
+		return OrgChart::PreorderIterator(names->data(), names->size(), names->size());
+	}
+
+	OrgChart::LevelOrderView OrgChart::level_order(const std::string& level) {
+		return LevelOrderView(cached_order(m_subtree_level_order, list_level_order, level));
+	}
+
+	OrgChart::ReverseOrderView OrgChart::reverse_level_order(const std::string& level) {
+		return ReverseOrderView(cached_order(m_subtree_reverse_order, list_reverse_level_order, level));
+	}
+
+	OrgChart::PreorderView OrgChart::preorder(const std::string& level) {
+		return PreorderView(cached_order(m_subtree_preorder, list_preorder, level));
 	}
 }
@@ -1,58 +1,192 @@
+#pragma once
+
+#include "ChartLog.hpp"
+#include "ChartWriter.hpp"
+#include "FlatTree.hpp"
+#include "ManagerIndex.hpp"
+
+#include <cstdint>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <queue>
 #include <stack>
 #include <iostream>
 
+#if __has_include(<ranges>)
+#include <ranges>
+#endif
+
 namespace ariel {
-	struct Tree {
-		std::string value;
-		std::vector<Tree*> children;
+	/**
+	 * @brief The orders an OrgChart can be traversed in
+	 * */
+	enum class TraversalOrder {
+		level,
+		reverse_level,
+		preorder
 	};
 
 	/**
-	 * @brief Helper function to recursively find a node in the tree by value
+	 * @brief helper function to list tree nodes in level order, by a BFS which uses the buffer
+	 * 		  itself as its queue
 	 *
-	 * @param root_node - The tree to search in
+	 * @param tree - The tree to list
 	 *
-	 * @param value - The value to search
+	 * @param root - The node to start from
 	 *
-	 * @return A pointer to the required node, nullptr if doesn't exist
+	 * @param size - The number of nodes the tree had at the version to list, later nodes are ignored
+	 *
+	 * @param order - The buffer to fill, its previous content is discarded
 	 * */
-	Tree* find_node_by_value(Tree* root_node, const std::string& value);
+	void list_level_order(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order);
 
 	/**
-	 * @brief Helper function to free all memory allocated in the tree
+	 * @brief helper function to list tree nodes in reverse level order: the deepest level first,
+	 * 		  and every level from left to right. Runs a BFS into the buffer, then flips the
+	 * 		  order of the levels in place, so it's linear and reuses the buffer's capacity.
+	 *
+	 * @param tree - The tree to list
+	 *
+	 * @param root - The node to start from
+	 *
+	 * @param size - The number of nodes the tree had at the version to list, later nodes are ignored
+	 *
+	 * @param order - The buffer to fill, its previous content is discarded
 	 * */
-	void delete_all_nodes_in_tree(Tree* root); 
+	void list_reverse_level_order(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order);
 
 	/**
-	 * @brief Helper function to recursively copy all the nodes in the tree
+	 * @brief helper function to list tree nodes in preorder, by walking the child, sibling and
+	 * 		  parent links so no stack is needed
+	 *
+	 * @param tree - The tree to list
+	 *
+	 * @param root - The node to start from
+	 *
+	 * @param size - The number of nodes the tree had at the version to list, later nodes are ignored
+	 *
+	 * @param order - The buffer to fill, its previous content is discarded
 	 * */
-	Tree* copy_tree(Tree* src_root);
+	void list_preorder(const FlatTree& tree, NodeId root, NodeId size, std::vector<NodeId>& order);
 
 	/**
-	 * @brief helper function to map tree nodes to their height
+	 * @brief helper function to find the interval of preorder positions of every subtree: node i
+	 * 		  is at position entry[i] of the preorder, followed by all the nodes under it, up to
+	 * 		  position exit[i]. A node's children come after it, so the subtree sizes are summed by
+	 * 		  one backward pass and the positions are handed out by one forward pass.
+	 *
+	 * @param tree - The tree to index
+	 *
+	 * @param size - The number of nodes the tree had at the version to index, later nodes are ignored
+	 *
+	 * @param entry - The buffer to fill with the preorder position of every node
+	 *
+	 * @param exit - The buffer to fill with the position after the subtree of every node
 	 * */
-	void map_tree_nodes(Tree* root, std::vector<std::pair<size_t, Tree*>>& node_depth_table, size_t curr_depth);
+	void index_subtrees(const FlatTree& tree, NodeId size, std::vector<NodeId>& entry, std::vector<NodeId>& exit);
 
 	/**
-	 * @brief helper function to compare node heights
+	 * @brief helper function to count the nodes of every subtree, the node itself included,
+	 * 		  bringing counts of the first nodes of the tree up to date with the nodes added
+	 * 		  after them. Every new node is counted by walking up from it, or if the walks would
+	 * 		  take longer than counting everything, by one backward pass over all the nodes.
+	 *
+	 * @param tree - The tree to count
+	 *
+	 * @param size - The number of nodes the tree had at the version to count, later nodes are ignored
+	 *
+	 * @param counts - The counts of the subtrees of the first nodes, at most size of them,
+	 * 				   extended to all the nodes
 	 * */
-	bool compare_heights(std::pair<size_t, Tree*> elem1, std::pair<size_t, Tree*> elem2);
+	void count_subtrees(const FlatTree& tree, NodeId size, std::vector<NodeId>& counts);
 
 	/**
-	 * @brief helper function to queue up tree nodes in a preorder traversal algorithm
+	 * @brief The sentinel at the end of every traversal of an OrgChart. An iterator is equal
+	 * 		  to it once it walked past the last rank of its order.
 	 * */
-	void queue_tree_nodes_preorder(Tree* root, std::queue<Tree*>& queue);
+	struct TraversalEnd {};
 
 	class OrgChart {
 		public:
-			class LevelOrderIterator;
+			/**
+			 * @brief An iterator over one of the traversal orders of the chart
+			 * */
+			template <TraversalOrder order>
+			class OrderIterator;
+
+			using LevelOrderIterator = OrderIterator<TraversalOrder::level>;
+
+			using ReverseOrderIterator = OrderIterator<TraversalOrder::reverse_level>;
+
+			using PreorderIterator = OrderIterator<TraversalOrder::preorder>;
+
+			/**
+			 * @brief A view of one of the traversal orders of the chart, that can be used with
+			 * 		  range-for loops, the standard range algorithms and the range adaptors
+			 * */
+			template <TraversalOrder order>
+			class OrderView;
+
+			using LevelOrderView = OrderView<TraversalOrder::level>;
+
+			using ReverseOrderView = OrderView<TraversalOrder::reverse_level>;
+
+			using PreorderView = OrderView<TraversalOrder::preorder>;
+
+			/**
+			 * @brief The name of a rank the iterators walk to: a view of the name held by the
+			 * 		  chart, with the members of std::string that read it (c_str, size, the
+			 * 		  comparisons, streaming and concatenation). It also converts to a
+			 * 		  std::string, so std::string name = *iter and names.push_back(*iter) copy it
+			 * 		  out like they did a std::string&.
+			 * */
+			class Rank: public std::string_view {
+				public:
+					using std::string_view::basic_string_view;
 
-			class ReverseOrderIterator;
+					explicit Rank(std::string_view name): std::string_view(name) {}
 
-			class PreorderIterator;
+					operator std::string() const {
+						return std::string(*this);
+					}
+
+					/**
+					 * @brief Get the name as a C string, valid while the chart holds the name.
+					 * 		  The chart keeps a '\0' after every name, so this doesn't copy it.
+					 * */
+					const char* c_str() const {
+						return data();
+					}
+
+					std::string str() const {
+						return std::string(*this);
+					}
+
+					friend std::string operator+(const Rank& rank, const std::string& other) {
+						return rank.str().append(other);
+					}
+
+					friend std::string operator+(const std::string& other, const Rank& rank) {
+						return std::string(other).append(rank);
+					}
+
+					friend std::string operator+(const Rank& rank, const char* other) {
+						return rank.str().append(other);
+					}
+
+					friend std::string operator+(const char* other, const Rank& rank) {
+						return std::string(other).append(rank);
+					}
+
+					friend std::string operator+(const Rank& rank, char other) {
+						return rank.str() + other;
+					}
+			};
 
 			OrgChart();
 
@@ -79,14 +213,16 @@ namespace ariel {
 			 * @brief Add a new child level under a given parent level
 			 *
 			 * @param parent - the Parent level under which the child will be placed.
-			 * 				   NOTE: Must exist already in the Chart
+			 * 				   NOTE: Must exist already in the Chart. If several levels
+			 * 				   share its name, the child goes under the first of them in
+			 * 				   preorder.
 			 *
 			 * @param child - the new child level
 			 * */
 			OrgChart& add_sub(const std::string& parent, const std::string& child);
 
 			/**
-			 * @brief Operator overload for stream output
+			 * @brief Operator overload for stream output, in the ChartFormat set on the stream
 			 *
 			 * @param output - The stream to write to
 			 *
@@ -96,6 +232,16 @@ namespace ariel {
 			 * */
 			friend std::ostream& operator<<(std::ostream& output, const OrgChart& me);
 
+			/**
+			 * @brief Write the chart to a stream, see ChartWriter
+			 *
+			 * @param output - The stream to write to
+			 *
+			 * @param format - The format to write in, nothing is written for an empty chart
+			 * 				   in the Indented one
+			 * */
+			void write(std::ostream& output, ChartFormat format) const;
+
 			/**
 			 * @brief Get an iterator over the OrgChart (by default - level order iteration)
 			 * */
@@ -136,170 +282,553 @@ namespace ariel {
 			 * */
 			PreorderIterator end_preorder();
 
-			class LevelOrderIterator: public std::iterator<std::input_iterator_tag, Tree*> {
-				public:
-					/**
-					 * @brief Constructor for the iterator over the OrgChart
-					 *
-					 * @param node - A pointer to the Tree which holds the data to the orgchart.
-					 * */
-					explicit LevelOrderIterator(Tree* node);
+			/**
+			 * @brief Get a view of the OrgChart by level order, empty if the chart is.
+			 * 		  Like the iterators, the view is invalidated by add_root or add_sub.
+			 * */
+			LevelOrderView level_order();
 
-					~LevelOrderIterator() = default;
+			/**
+			 * @brief Get a view of the OrgChart by reverse level order, empty if the chart is
+			 * */
+			ReverseOrderView reverse_level_order();
 
-					LevelOrderIterator(const LevelOrderIterator& other);
+			/**
+			 * @brief Get a view of the OrgChart by pre order, empty if the chart is
+			 * */
+			PreorderView preorder();
 
-					LevelOrderIterator& operator=(const LevelOrderIterator& other);
+			/**
+			 * @brief Get an iterator over the levels under a level, itself included, to be
+			 * 		  iterated by level order. Only the levels under it are listed, so the
+			 * 		  work is proportional to their number rather than to the whole chart's.
+			 * 		  If several levels have the name, it's the one add_sub would add under.
+			 *
+			 * 		  Every order keeps the last level it was listed under, so the iterators
+			 * 		  under a level are also invalidated by iterating under another level
+			 * 		  in the same order.
+			 *
+			 * @param level - The head of the levels to iterate over, must exist in the chart
+			 * */
+			LevelOrderIterator begin_level_order(const std::string& level);
 
-					LevelOrderIterator(LevelOrderIterator&& other) noexcept;
+			/**
+			 * @brief Get an iterator to the end of the levels under a level, by level order
+			 * */
+			LevelOrderIterator end_level_order(const std::string& level);
 
-					LevelOrderIterator& operator=(LevelOrderIterator&& other) noexcept;
+			/**
+			 * @brief Get an iterator over the levels under a level, itself included, to be
+			 * 		  iterated by reverse order
+			 * */
+			ReverseOrderIterator begin_reverse_order(const std::string& level);
 
-					/**
-					 * @brief An operator overload for the increment operator for the iterator over the OrgChart
-					 * 		  Will go by level order (go to the next rank by order)
-					 *
-					 * @return the iterator object to the next rank
-					 * */
-					LevelOrderIterator& operator++();
+			/**
+			 * @brief Get an iterator to the end of the levels under a level, by reverse order
+			 * */
+			ReverseOrderIterator reverse_order(const std::string& level);
+
+			/**
+			 * @brief Get an iterator over the levels under a level, itself included, to be
+			 * 		  iterated by pre order
+			 * */
+			PreorderIterator begin_preorder(const std::string& level);
+
+			/**
+			 * @brief Get an iterator to the end of the levels under a level, by pre order
+			 * */
+			PreorderIterator end_preorder(const std::string& level);
+
+			/**
+			 * @brief Get a view of the levels under a level by level order, see begin_level_order
+			 * */
+			LevelOrderView level_order(const std::string& level);
+
+			/**
+			 * @brief Get a view of the levels under a level by reverse level order
+			 * */
+			ReverseOrderView reverse_level_order(const std::string& level);
+
+			/**
+			 * @brief Get a view of the levels under a level by pre order
+			 * */
+			PreorderView preorder(const std::string& level);
+
+			/**
+			 * @brief Check whether a level reports to another, directly or through other levels.
+			 * 		  Answered by two comparisons of the levels' preorder intervals, which are
+			 * 		  indexed again on the first check after add_root or add_sub.
+			 *
+			 * @param level - The level that may report to the manager, must exist in the chart
+			 *
+			 * @param manager - The level that may be above it, must exist in the chart
+			 *
+			 * @return Whether the level is under the manager, false for the manager itself
+			 * */
+			bool is_under(const std::string& level, const std::string& manager);
+
+			/**
+			 * @brief Get the lowest level that two levels both report to, for routing something
+			 * 		  that needs both their approvals. Answered in O(1) plus a scan of two short
+			 * 		  blocks of a preorder index, which is built again on the first query after
+			 * 		  add_root or add_sub.
+			 *
+			 * @param first, second - Levels of the chart, they may be the same level
+			 *
+			 * @return The name of the level, one of them if the other reports to it. Like the
+			 * 		   iterators' values, it's invalidated by add_root or add_sub.
+			 * */
+			std::string_view common_manager(const std::string& first, const std::string& second);
+
+			/**
+			 * @brief Same as common_manager, for many pairs of levels at once. The index is
+			 * 		  checked once for all of them, and the queries are split between threads.
+			 *
+			 * @param pairs - The pairs of levels, all must exist in the chart
+			 *
+			 * @param threads - The number of threads to split the pairs between
+			 *
+			 * @return The lowest common manager of every pair, in the same order
+			 * */
+			std::vector<std::string_view> common_managers(const std::vector<std::pair<std::string, std::string>>& pairs,
+				unsigned threads = 1);
+
+			/**
+			 * @brief Get the number of levels that report to a level, directly or through other
+			 * 		  levels. The counts of all the levels are kept, and only the levels added since
+			 * 		  the last call are counted into them.
+			 *
+			 * @param level - The level, must exist in the chart
+			 *
+			 * @return The number of levels under it, 0 for a level with no subordinates
+			 * */
+			size_t headcount(const std::string& level);
+
+			/**
+			 * @brief Get the number of levels between a level and the root
+			 *
+			 * @param level - The level, must exist in the chart
+			 *
+			 * @return The depth of the level, 0 for the root
+			 * */
+			size_t depth(const std::string& level) const;
+
+			/**
+			 * @brief Get the number of levels in the chart
+			 * */
+			size_t size() const;
+
+			/**
+			 * @brief Get the version of the chart: the number of add_root and add_sub calls
+			 * 		  that made it
+			 * */
+			size_t version() const;
+
+			/**
+			 * @brief Get a read only chart of how this one was at an older version, in O(1).
+			 * 		  The version shares the nodes of the chart like a copy, and the chart's
+			 * 		  next edit copies only the chunks it writes away from it. So the version
+			 * 		  can be read on another thread while the chart is modified, and the values
+			 * 		  read from it stay valid while it exists.
+			 *
+			 * @param version - The version, at most the chart's
+			 * */
+			OrgChart at_version(size_t version) const;
+
+			/**
+			 * @brief Copy the chart into nodes of its own right away, instead of sharing them
+			 * 		  chunk by chunk like a plain copy, so neither chart keeps the other's
+			 * 		  chunks alive, and the copy's edits never copy a chunk
+			 *
+			 * @param threads - The number of threads to copy the node arrays on at once
+			 * */
+			OrgChart deep_copy(unsigned threads = 1) const;
+
+			/**
+			 * @brief Save the chart to a binary file, see ChartFile. Only the chart's version
+			 * 		  is saved, not the older ones.
+			 *
+			 * @param path - The file to save to, replaced if it exists
+			 *
+			 * @throws std::runtime_error if the file can't be written
+			 * */
+			void save(const std::string& path) const;
+
+			/**
+			 * @brief Load a chart saved by save, with the same levels in the same order. Its
+			 * 		  version counts the root and every level as added once.
+			 *
+			 * @param path - The file to load from
+			 *
+			 * @throws std::runtime_error if the file can't be read or is corrupt
+			 * */
+			static OrgChart load(const std::string& path);
+
+			/**
+			 * @brief Map a chart saved by save into memory and read it in place, see
+			 * 		  ChartFile::map. Opening it takes O(1) whatever its size, and processes that
+			 * 		  map the same file share its memory. The chart is read only, like an older
+			 * 		  version, and its traversals and lookups work as a loaded chart's.
+			 *
+			 * @param path - The file to map, which mustn't be modified while it's mapped
+			 *
+			 * @param verify - Whether to compare the whole file with its checksum first
+			 *
+			 * @throws std::runtime_error if the file can't be mapped or isn't a chart file
+			 * */
+			static OrgChart map(const std::string& path, bool verify = false);
+
+			/**
+			 * @brief Open a chart kept at a path as a snapshot saved by save and a log of the
+			 * 		  changes made since, see ChartLog, creating it if there's none. From then on
+			 * 		  every add_root and add_sub of the chart is appended to the log, so saving
+			 * 		  a change costs as much as the change. Copies of the chart aren't logged,
+			 * 		  and assigning another chart to it closes its log.
+			 *
+			 * 		  If a change can't be logged, it's still made to the chart, and add_root or
+			 * 		  add_sub throws std::runtime_error.
+			 *
+			 * @param path - The snapshot's path, the log is at path + ".log"
+			 *
+			 * @throws std::runtime_error if the files can't be read or written or are corrupt
+			 * */
+			static OrgChart open(const std::string& path);
+
+			/**
+			 * @brief Write the changes logged so far through to the disk
+			 *
+			 * @throws std::logic_error if the chart wasn't opened by open
+			 * */
+			void sync();
+
+			/**
+			 * @brief Fold the changes logged so far into a new snapshot, see ChartLog::compact.
+			 * 		  The snapshot is made from the files, so the chart isn't copied and can be
+			 * 		  modified meanwhile.
+			 *
+			 * @param background - Whether to save the snapshot on a thread of its own and
+			 * 					   return right away
+			 *
+			 * @throws std::logic_error if the chart wasn't opened by open
+			 * */
+			void compact(bool background = true);
+
+			/**
+			 * @brief Choose whether charts destroyed from now on release their nodes, caches
+			 * 		  and indices, and close their log, on a background thread, so their
+			 * 		  destructor returns right away. Off by default. A chart destroyed when the
+			 * 		  program exits is released in the foreground. Opening a chart whose log is
+			 * 		  still being closed waits for it, and for its compaction.
+			 * */
+			static void destroy_in_background(bool enabled);
+
+			/**
+			 * @brief The iterators walk an order listed by the chart into an array of the names of
+			 * 		  its nodes. Every order is listed once and then served from the chart's cache
+			 * 		  until the next add_root or add_sub, which invalidates the iterators. Moving the
+			 * 		  chart doesn't, the array moves along with it.
+			 * 		  Since the order is an array the iterators refer to, they are random access.
+			 * */
+			template <TraversalOrder order>
+			class OrderIterator {
+				public:
+					using iterator_category = std::random_access_iterator_tag;
+					using value_type = Rank;
+					using reference = const Rank&;
+					using pointer = const Rank*;
+					using difference_type = std::ptrdiff_t;
 
 					/**
-					 * @brief and operator overload for the equals operator, will determine whether
-					 * 		  Two iterators are the same
+					 * @brief An iterator that isn't over any chart, only to be assigned to
 					 * */
-					bool operator==(const LevelOrderIterator& other) const;
+					OrderIterator();
 
 					/**
-					 * @brief and operator overload for the equals operator, will determine whether
-					 * 		  Two iterators are not the same
+					 * @brief Constructor for the iterator over the OrgChart
+					 *
+					 * @param names - The names of the chart's nodes listed in this iterator's order.
+					 *
+					 * @param size - The number of names in the order.
+					 *
+					 * @param position - The index in the order to start from, its size for the end.
 					 * */
-					bool operator!=(const LevelOrderIterator& other) const;
+					OrderIterator(const Rank* names, size_t size, size_t position = 0);
 
 					/**
-					 * @brief A dereference operator overload for an iterator, will return the held value
+					 * @brief An operator overload for the increment operator for the iterator over the OrgChart
+					 * 		  Will go to the next rank by the iterator's order
+					 *
+					 * @return the iterator object to the next rank
 					 * */
-					std::string& operator*();
+					OrderIterator& operator++();
+
+					OrderIterator operator++(int);
 
 					/**
-					 * @brief A struct deref oeprator overload for the iterator, will allow access to the held value.
+					 * @brief Go back to the previous rank by the iterator's order
 					 * */
-					std::string* operator->();
+					OrderIterator& operator--();
 
-				private:
-					Tree* m_node;
-					std::queue<Tree*> m_iteration_queue;
-			};
+					OrderIterator operator--(int);
 
-			class ReverseOrderIterator: public std::iterator<std::input_iterator_tag, Tree*> {
-				public:
 					/**
-					 * @brief Constructor for the iterator over the OrgChart
-					 *
-					 * @param node - A pointer to the Tree which holds the data to the orgchart.
+					 * @brief Jump a number of ranks forward (or backward if negative), in O(1)
 					 * */
-					explicit ReverseOrderIterator(Tree* node);
+					OrderIterator& operator+=(difference_type offset);
 
-					~ReverseOrderIterator() = default;
+					OrderIterator& operator-=(difference_type offset);
 
-					ReverseOrderIterator(const ReverseOrderIterator& other);
+					OrderIterator operator+(difference_type offset) const;
 
-					ReverseOrderIterator& operator=(const ReverseOrderIterator& other);
+					OrderIterator operator-(difference_type offset) const;
 
-					ReverseOrderIterator(ReverseOrderIterator&& other) noexcept;
+					friend OrderIterator operator+(difference_type offset, const OrderIterator& iterator) {
+						return iterator + offset;
+					}
 
-					ReverseOrderIterator& operator=(ReverseOrderIterator&& other) noexcept;
+					/**
+					 * @brief Get the number of ranks between two iterators over the same order
+					 * */
+					difference_type operator-(const OrderIterator& other) const;
 
 					/**
-					 * @brief An operator overload for the increment operator for the iterator over the OrgChart
-					 * 		  Will go by reverse level order (go to the next lower rank by order)
-					 *
-					 * @return the iterator object to the next rank
+					 * @brief Get the value of the rank a number of ranks away from this one
 					 * */
-					ReverseOrderIterator& operator++();
+					const Rank& operator[](difference_type offset) const;
+
+					bool operator<(const OrderIterator& other) const;
+
+					bool operator>(const OrderIterator& other) const;
+
+					bool operator<=(const OrderIterator& other) const;
+
+					bool operator>=(const OrderIterator& other) const;
 
 					/**
 					 * @brief and operator overload for the equals operator, will determine whether
-					 * 		  Two iterators are the same
+					 * 		  Two iterators are the same: at the same position of the same order,
+					 * 		  without looking at the names
 					 * */
-					bool operator==(const ReverseOrderIterator& other) const;
-					
+					bool operator==(const OrderIterator& other) const;
+
 					/**
 					 * @brief and operator overload for the equals operator, will determine whether
 					 * 		  Two iterators are not the same
 					 * */
-					bool operator!=(const ReverseOrderIterator& other) const;
+					bool operator!=(const OrderIterator& other) const;
+
+					/**
+					 * @brief Check whether the iterator walked past the last rank of its order
+					 * */
+					friend bool operator==(const OrderIterator& iterator, TraversalEnd) {
+						return iterator.m_position == iterator.m_size;
+					}
+
+					friend bool operator==(TraversalEnd end, const OrderIterator& iterator) {
+						return iterator == end;
+					}
+
+					friend bool operator!=(const OrderIterator& iterator, TraversalEnd end) {
+						return !(iterator == end);
+					}
+
+					friend bool operator!=(TraversalEnd end, const OrderIterator& iterator) {
+						return !(iterator == end);
+					}
+
+					/**
+					 * @brief Get the number of ranks left until the end of the order
+					 * */
+					friend difference_type operator-(TraversalEnd, const OrderIterator& iterator) {
+						return static_cast<difference_type>(iterator.m_size - iterator.m_position);
+					}
+
+					friend difference_type operator-(const OrderIterator& iterator, TraversalEnd end) {
+						return -(end - iterator);
+					}
 
 					/**
 					 * @brief A dereference operator overload for an iterator, will return the held value
 					 * */
-					std::string& operator*();
+					const Rank& operator*() const;
 
 					/**
 					 * @brief A struct deref oeprator overload for the iterator, will allow access to the held value.
 					 * */
-					std::string* operator->();
+					const Rank* operator->() const;
 
 				private:
-					Tree* m_node;
-					std::vector<std::pair<size_t, Tree*>> m_iteration_vector;
+					// The cached order's array and size, which stay the same when the chart is
+					// moved since the cache moves its buffer along with it
+					const Rank* m_names;
+					size_t m_size;
+					size_t m_position;
 			};
 
-			class PreorderIterator: public std::iterator<std::input_iterator_tag, Tree*> {
+			/**
+			 * @brief The view only points into the chart's traversal cache, so it's cheap to
+			 * 		  copy and its iterators stay valid after it's gone
+			 * */
+			template <TraversalOrder order>
+			class OrderView {
 				public:
-					/**
-					 * @brief Constructor for the iterator over the OrgChart
-					 *
-					explicit PreorderIterator(Tree* node);
-					 * */
-					explicit PreorderIterator(Tree* node);
+					explicit OrderView(const std::vector<Rank>* names): m_names(names->data()), m_size(names->size()) {}
 
-					~PreorderIterator() = default;
+					OrderIterator<order> begin() const {
+						return OrderIterator<order>(m_names, m_size);
+					}
 
-					PreorderIterator(const PreorderIterator& other);
+					TraversalEnd end() const {
+						return TraversalEnd{};
+					}
 
-					PreorderIterator& operator=(const PreorderIterator& other);
+					size_t size() const {
+						return m_size;
+					}
 
-					PreorderIterator(PreorderIterator&& other) noexcept;
+					bool empty() const {
+						return m_size == 0;
+					}
 
-					PreorderIterator& operator=(PreorderIterator&& other) noexcept;
+				private:
+					const Rank* m_names;
+					size_t m_size;
+			};
 
-					/**
-					 * @brief An operator overload for the increment operator for the iterator over the OrgChart
-					 * 		  Will go by preorder over the tree
-					 *
-					 * @return the iterator object to the next rank
-					 * */
-					PreorderIterator& operator++();
+		private:
+			friend class ChartBuilder;
 
-					/**
-					 * @brief and operator overload for the equals operator, will determine whether
-					 * 		  Two iterators are the same
-					 * */
-					bool operator==(const PreorderIterator& other) const;
+			/**
+			 * @brief Create a chart of the nodes of a tree
+			 * */
+			explicit OrgChart(FlatTree tree);
 
-					/**
-					 * @brief and operator overload for the equals operator, will determine whether
-					 * 		  Two iterators are not the same
-					 * */
-					bool operator!=(const PreorderIterator& other) const;
+			/**
+			 * @brief A traversal order listed from the tree, valid while its epoch is the chart's
+			 * */
+			struct TraversalCache {
+				std::vector<Rank> names;
+				std::uint64_t epoch = 0;
 
+				// The node the order starts from
+				NodeId root = 0;
 
-					/**
-					 * @brief A dereference operator overload for an iterator, will return the held value
-					 * */
-					std::string& operator*();
+				// The version of the nodes the names were read at. The chart a version was taken
+				// from keeps appending to its nodes, which can move the names of the version too.
+				size_t nodes_version = 0;
+			};
 
-					/**
-					 * @brief A struct deref oeprator overload for the iterator, will allow access to the held value.
-					 * */
-					std::string* operator->();
+			/**
+			 * @brief The preorder intervals of the subtrees, see index_subtrees. Valid while its
+			 * 		  epoch is the chart's.
+			 * */
+			struct SubtreeIndex {
+				std::vector<NodeId> entry;
+				std::vector<NodeId> exit;
+				std::uint64_t epoch = 0;
+			};
 
-				private:
-					Tree* m_node;
-					std::queue<Tree*> m_iteration_queue;
+			/**
+			 * @brief Get the preorder intervals of the subtrees, indexing them again only if the
+			 * 		  chart was modified since they were last indexed
+			 * */
+			const SubtreeIndex& subtree_index();
+
+			/**
+			 * @brief The lowest common managers index, valid while its epoch is the chart's
+			 * */
+			struct CommonManagerIndex {
+				ManagerIndex managers;
+				std::uint64_t epoch = 0;
 			};
 
-		private:
-			Tree* m_root;
+			/**
+			 * @brief Get the lowest common managers index, building it again only if the chart
+			 * 		  was modified since it was last built
+			 * */
+			const ManagerIndex& manager_index();
+
+			/**
+			 * @brief Get the name of a node at the chart's version
+			 * */
+			std::string_view node_name(NodeId node) const;
+
+			/**
+			 * @brief Same as find_node, throwing if there's no level by that name
+			 * */
+			NodeId find_existing_node(std::string_view level) const;
+
+			/**
+			 * @brief Get the names of the chart's nodes in a traversal order, listing them again
+			 * 		  only if the chart was modified since they were last listed
+			 * */
+			const std::vector<Rank>* cached_order(TraversalCache& cache,
+				void (*list_order)(const FlatTree&, NodeId, NodeId, std::vector<NodeId>&), NodeId root = 0);
+
+			/**
+			 * @brief Same as cached_order, for the nodes under a level of the chart
+			 * */
+			const std::vector<Rank>* cached_order(TraversalCache& cache,
+				void (*list_order)(const FlatTree&, NodeId, NodeId, std::vector<NodeId>&), const std::string& level);
+
+			/**
+			 * @brief Find the node add_sub would add under, at the chart's version
+			 *
+			 * @return The index of the node, NO_NODE if there's no level by that name
+			 * */
+			NodeId find_node(std::string_view level) const;
+
+			/**
+			 * @brief Get the nodes of the chart, an empty tree if there are none
+			 * */
+			const FlatTree& tree() const;
+
+			/**
+			 * @brief Get the nodes of the chart for modification. Copies of a chart share their
+			 * 		  nodes, so the first modification of a shared chart gives it a tree of its
+			 * 		  own, which still shares every chunk of the arrays it doesn't write.
+			 * */
+			FlatTree& writable_tree();
+
+			// Shared between copies and versions of the chart until one of them is modified, null
+			// while empty
+			std::shared_ptr<FlatTree> m_tree;
+
+			static constexpr size_t LATEST_VERSION = std::numeric_limits<size_t>::max();
+
+			// The version of a read only chart returned by at_version or map, LATEST_VERSION otherwise
+			size_t m_version = LATEST_VERSION;
+
+			// Bumped by every modification of the chart, so caches of an older epoch are stale
+			std::uint64_t m_epoch = 1;
+
+			TraversalCache m_level_order;
+			TraversalCache m_reverse_order;
+			TraversalCache m_preorder;
+
+			TraversalCache m_subtree_level_order;
+			TraversalCache m_subtree_reverse_order;
+			TraversalCache m_subtree_preorder;
+
+			// The nodes of the order being cached, before they're replaced by their names
+			std::vector<NodeId> m_listed_nodes;
+
+			SubtreeIndex m_subtree_index;
+			CommonManagerIndex m_manager_index;
+
+			// The number of nodes in the subtree of each of the first nodes, see count_subtrees.
+			// Nodes are only appended, so these stay right for the chart's nodes until it's assigned.
+			std::vector<NodeId> m_headcounts;
+
+			// The log the changes are appended to if the chart was opened by open, never shared
+			std::unique_ptr<ChartLog> m_log;
 	};
 }
+
+#if defined(__cpp_lib_ranges)
+template <ariel::TraversalOrder order>
+inline constexpr bool std::ranges::enable_view<ariel::OrgChart::OrderView<order>> = true;
+
+template <ariel::TraversalOrder order>
+inline constexpr bool std::ranges::enable_borrowed_range<ariel::OrgChart::OrderView<order>> = true;
+#endif
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief The least number of indices worth handing to a thread of its own
+	 * */
+	constexpr size_t MIN_INDICES_PER_THREAD = 4096;
+
+	/**
+	 * @brief Get the number of threads to split a range of indices between, at most the
+	 * 		  number requested and at least one
+	 * */
+	inline unsigned split_threads(size_t count, unsigned threads) {
+		size_t useful = (count + MIN_INDICES_PER_THREAD - 1) / MIN_INDICES_PER_THREAD;
+		return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, useful)));
+	}
+
+	/**
+	 * @brief Run a function over a range of indices split into one contiguous block per
+	 * 		  thread, calling it as function(block_begin, block_end, block). The calling thread
+	 * 		  runs the first block, and the blocks of any thread that couldn't be started. The
+	 * 		  function mustn't throw.
+	 *
+	 * @param threads - The number of blocks, see split_threads
+	 * */
+	template <typename Function>
+	void parallel_blocks(size_t begin, size_t end, unsigned threads, Function function) {
+		// Joins the threads started so far however parallel_blocks returns, since a thread
+		// that's destroyed unjoined terminates the process
+		struct Workers {
+			std::vector<std::thread> threads;
+
+			~Workers() {
+				for (std::thread& worker: threads) {
+					worker.join();
+				}
+			}
+		} workers;
+
+		const size_t count = end - begin;
+		auto block_begin = [&](unsigned block) {
+			return begin + count * block / threads;
+		};
+		workers.threads.reserve(threads - 1);
+		unsigned started = 1;
+		for (; started < threads; ++started) {
+			try {
+				workers.threads.emplace_back(function, block_begin(started), block_begin(started + 1), started);
+			} catch (const std::system_error&) {
+				break;
+			}
+		}
+		function(begin, block_begin(1), 0U);
+		for (unsigned block = started; block < threads; ++block) {
+			function(block_begin(block), block_begin(block + 1), block);
+		}
+	}
+
+	/**
+	 * @brief Run a function on every index of a range, calling it as function(index), split
+	 * 		  between up to a number of threads. The function mustn't throw.
+	 * */
+	template <typename Function>
+	void parallel_for(size_t begin, size_t end, unsigned threads, Function function) {
+		parallel_blocks(begin, end, split_threads(end - begin, threads), [&function](size_t block_begin, size_t block_end, unsigned) {
+			for (size_t i = block_begin; i < block_end; ++i) {
+				function(i);
+			}
+		});
+	}
+
+	/**
+	 * @brief Replace every value of an array by the sum of the values before it, split between
+	 * 		  up to a number of threads: every block is summed, the sums are scanned, and then
+	 * 		  every block is scanned from its offset.
+	 *
+	 * @return The sum of all the values
+	 * */
+	template <typename T>
+	T parallel_exclusive_scan(T* values, size_t count, unsigned threads) {
+		threads = split_threads(count, threads);
+		std::vector<T> block_sums(threads + 1, T());
+		parallel_blocks(0, count, threads, [&](size_t block_begin, size_t block_end, unsigned block) {
+			T sum = T();
+			for (size_t i = block_begin; i < block_end; ++i) {
+				sum += values[i];
+			}
+			block_sums[block + 1] = sum;
+		});
+		for (unsigned block = 0; block < threads; ++block) {
+			block_sums[block + 1] += block_sums[block];
+		}
+		parallel_blocks(0, count, threads, [&](size_t block_begin, size_t block_end, unsigned block) {
+			T sum = block_sums[block];
+			for (size_t i = block_begin; i < block_end; ++i) {
+				T value = values[i];
+				values[i] = sum;
+				sum += value;
+			}
+		});
+		return block_sums[threads];
+	}
+
+	/**
+	 * @brief Run a list of independent tasks on up to a number of threads. Every thread takes
+	 * 		  the next task left as soon as it's done with its previous one, so a few long tasks
+	 * 		  don't hold up the short ones. If tasks throw, the first exception is rethrown once
+	 * 		  all of them are done.
+	 * */
+	inline void parallel_tasks(const std::vector<std::function<void()>>& tasks, unsigned threads) {
+		std::atomic<size_t> next_task(0);
+		std::mutex error_mutex;
+		std::exception_ptr error;
+		auto run_tasks = [&](size_t, size_t, unsigned) {
+			for (size_t task = next_task++; task < tasks.size(); task = next_task++) {
+				try {
+					tasks[task]();
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+			}
+		};
+		parallel_blocks(0, tasks.size(), static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, tasks.size()))), run_tasks);
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
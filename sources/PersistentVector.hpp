@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief An array of values kept in fixed chunks, which copies of the array share until
+	 * 		  they're written. A copy is O(1): it shares the table of the chunks. The first
+	 * 		  write to a shared array copies the table, a pointer per chunk, and every write
+	 * 		  copies its chunk if any other table still holds it, so an edit of a copy costs a
+	 * 		  chunk and the table rather than the whole array. Reads go through the table, one
+	 * 		  more load than a plain vector.
+	 *
+	 * 		  The chunks can also be read in place from a mapped file, which is then held by
+	 * 		  them, and is never written: a write copies its chunk like a shared one.
+	 *
+	 * 		  Copies can be read and copied on several threads at once, and each one written on
+	 * 		  the thread that owns it, like a std::shared_ptr. The non-const accessor doesn't
+	 * 		  copy anything, so it's as cheap as the vector's own, and must only be used on an
+	 * 		  array that nothing shares, like one just filled in bulk.
+	 * */
+	template <typename T>
+	class PersistentVector {
+		public:
+			using value_type = T;
+
+			static constexpr size_t CHUNK_BYTES = 16384;
+			static constexpr size_t CHUNK_SIZE = CHUNK_BYTES / sizeof(T);
+			static_assert((CHUNK_SIZE & (CHUNK_SIZE - 1)) == 0, "Values must fit a power of two times in a chunk");
+
+			PersistentVector() = default;
+
+			PersistentVector(std::initializer_list<T> values) {
+				append(values.begin(), values.size());
+			}
+
+			PersistentVector(size_t size, const T& value) {
+				resize(size, value);
+			}
+
+			PersistentVector(const PersistentVector& other) = default;
+
+			PersistentVector(PersistentVector&& other) noexcept:
+				m_table(std::move(other.m_table)), m_chunks(other.m_chunks), m_size(other.m_size) {
+				other.m_chunks = nullptr;
+				other.m_size = 0;
+			}
+
+			PersistentVector& operator=(const PersistentVector& other) = default;
+
+			PersistentVector& operator=(PersistentVector&& other) noexcept {
+				if (this != &other) {
+					m_table = std::move(other.m_table);
+					m_chunks = other.m_chunks;
+					m_size = other.m_size;
+					other.m_chunks = nullptr;
+					other.m_size = 0;
+				}
+				return *this;
+			}
+
+			/**
+			 * @brief Read the values from an array in place, held by a mapping that the chunks
+			 * 		  keep alive
+			 * */
+			void map(const T* data, size_t size, std::shared_ptr<const void> mapping) {
+				*this = PersistentVector();
+				if (size == 0) {
+					return;
+				}
+
+				m_table = std::make_shared<Table>();
+				for (size_t begin = 0; begin < size; begin += CHUNK_SIZE) {
+					m_table->data.push_back(const_cast<T*>(data + begin));
+					m_table->chunks.push_back(Chunk{mapping, false});
+				}
+				m_table->last_capacity = size - (m_table->data.size() - 1) * CHUNK_SIZE;
+				m_chunks = m_table->data.data();
+				m_size = size;
+			}
+
+			/**
+			 * @brief Copy the values into chunks of a new array, which shares nothing
+			 * */
+			PersistentVector copy() const {
+				PersistentVector copy;
+				copy.reserve(m_size);
+				for (size_t chunk = 0; chunk < chunk_count(); ++chunk) {
+					copy.append(m_chunks[chunk], chunk_size(chunk));
+				}
+				return copy;
+			}
+
+			const T& operator[](size_t index) const {
+				return m_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+			}
+
+			T& operator[](size_t index) {
+				return m_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+			}
+
+			/**
+			 * @brief Write a value, copying its chunk first if it's shared
+			 * */
+			void set(size_t index, const T& value) {
+				writable_chunk(index / CHUNK_SIZE)[index % CHUNK_SIZE] = value;
+			}
+
+			const T& back() const {
+				return (*this)[m_size - 1];
+			}
+
+			size_t size() const {
+				return m_size;
+			}
+
+			bool empty() const {
+				return m_size == 0;
+			}
+
+			/**
+			 * @brief Get the number of chunks the values are kept in
+			 * */
+			size_t chunk_count() const {
+				return m_table ? m_table->data.size() : 0;
+			}
+
+			/**
+			 * @brief Get the values of a chunk, chunk_size of them in a row
+			 * */
+			const T* chunk(size_t chunk) const {
+				return m_chunks[chunk];
+			}
+
+			/**
+			 * @brief Get the values of a chunk for modification, without copying it, like the
+			 * 		  non-const operator[]
+			 * */
+			T* chunk(size_t chunk) {
+				return m_chunks[chunk];
+			}
+
+			/**
+			 * @brief Get the number of values in a chunk, CHUNK_SIZE in all but the last one
+			 * */
+			size_t chunk_size(size_t chunk) const {
+				return std::min(CHUNK_SIZE, m_size - chunk * CHUNK_SIZE);
+			}
+
+			void push_back(const T& value) {
+				const size_t offset = m_size % CHUNK_SIZE;
+				appendable_chunk(offset + 1)[offset] = value;
+				++m_size;
+			}
+
+			/**
+			 * @brief Append a number of values from an array
+			 * */
+			void append(const T* values, size_t count) {
+				while (count != 0) {
+					const size_t offset = m_size % CHUNK_SIZE;
+					const size_t placed = std::min(count, CHUNK_SIZE - offset);
+					std::copy(values, values + placed, appendable_chunk(offset + placed) + offset);
+					values += placed;
+					count -= placed;
+					m_size += placed;
+				}
+			}
+
+			/**
+			 * @brief Append a number of values that stay in a row in memory: after the values of
+			 * 		  the last chunk if they fit in it, and otherwise from the start of the next
+			 * 		  chunk, in as many chunks as they take, allocated at once. The rest of the
+			 * 		  last chunk is then skipped, filled with T().
+			 *
+			 * @param padding - A number of T() to append after the values, in the same row
+			 *
+			 * @return The index of the first of the values
+			 * */
+			size_t append_in_row(const T* values, size_t count, size_t padding = 0) {
+				const size_t offset = m_size % CHUNK_SIZE;
+				const size_t total = count + padding;
+				if (offset != 0 && offset + total <= CHUNK_SIZE) {
+					append(values, count);
+					resize(m_size + padding, T());
+					return m_size - total;
+				}
+				if (total <= CHUNK_SIZE) {
+					resize((m_size + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE, T());
+					append(values, count);
+					resize(m_size + padding, T());
+					return m_size - total;
+				}
+
+				// A run of chunks in one allocation, every chunk holding it
+				resize((m_size + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE, T());
+				const size_t chunks = (total + CHUNK_SIZE - 1) / CHUNK_SIZE;
+				std::shared_ptr<T> run(new T[chunks * CHUNK_SIZE](), std::default_delete<T[]>());
+				std::copy(values, values + count, run.get());
+				Table& table = writable_table();
+				for (size_t chunk = 0; chunk < chunks; ++chunk) {
+					table.data.push_back(run.get() + chunk * CHUNK_SIZE);
+					table.chunks.push_back(Chunk{run, true});
+				}
+				table.last_capacity = CHUNK_SIZE;
+				m_chunks = table.data.data();
+				m_size += total;
+				return m_size - total;
+			}
+
+			void resize(size_t size) {
+				resize(size, T());
+			}
+
+			void resize(size_t size, const T& value) {
+				if (size <= m_size) {
+					if (size == 0) {
+						*this = PersistentVector();
+						return;
+					}
+
+					const size_t chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+					if (chunks != chunk_count()) {
+						Table& table = writable_table();
+						table.last_capacity = capacity(chunks - 1);
+						table.data.resize(chunks);
+						table.chunks.resize(chunks);
+						m_chunks = table.data.data();
+					}
+					m_size = size;
+					return;
+				}
+
+				while (m_size < size) {
+					const size_t offset = m_size % CHUNK_SIZE;
+					const size_t placed = std::min(size - m_size, CHUNK_SIZE - offset);
+					std::fill_n(appendable_chunk(offset + placed) + offset, placed, value);
+					m_size += placed;
+				}
+			}
+
+			void assign(size_t size, const T& value) {
+				*this = PersistentVector();
+				resize(size, value);
+			}
+
+			/**
+			 * @brief Make room in the table for the chunks of a number of values
+			 * */
+			void reserve(size_t capacity) {
+				Table& table = writable_table();
+				table.data.reserve((capacity + CHUNK_SIZE - 1) / CHUNK_SIZE);
+				table.chunks.reserve(table.data.capacity());
+				m_chunks = table.data.data();
+			}
+
+			/**
+			 * @brief Get the number of bytes of the chunks and the table, 0 for the chunks
+			 * 		  read from a mapped file
+			 *
+			 * @param unshared - Whether to count only what no other array holds
+			 * */
+			size_t memory_usage(bool unshared = false) const {
+				if (!m_table || (unshared && m_table.use_count() != 1)) {
+					return 0;
+				}
+
+				size_t bytes = sizeof(Table) + m_table->data.capacity() * sizeof(T*) + m_table->chunks.capacity() * sizeof(Chunk);
+				for (size_t chunk = 0; chunk < chunk_count(); ++chunk) {
+					const Chunk& held = m_table->chunks[chunk];
+					if (held.owned && (!unshared || held.holder.use_count() == 1)) {
+						bytes += capacity(chunk) * sizeof(T);
+					}
+				}
+				return bytes;
+			}
+
+		private:
+			/**
+			 * @brief What keeps a chunk alive: its own allocation, the run of chunks it was
+			 * 		  allocated with, or the mapping it's read from
+			 * */
+			struct Chunk {
+				std::shared_ptr<const void> holder;
+
+				// Whether it was allocated by an array, rather than mapped
+				bool owned;
+			};
+
+			struct Table {
+				std::vector<T*> data;
+				std::vector<Chunk> chunks;
+
+				// The number of values the last chunk has room for, which grows up to
+				// CHUNK_SIZE like a vector's, so a small array takes a small chunk
+				size_t last_capacity = 0;
+			};
+
+			static constexpr size_t MIN_CAPACITY = 16;
+
+			size_t capacity(size_t chunk) const {
+				return chunk + 1 == chunk_count() ? m_table->last_capacity : CHUNK_SIZE;
+			}
+
+			/**
+			 * @brief Get the table for modification, copying it first if it's shared
+			 * */
+			Table& writable_table() {
+				if (!m_table) {
+					m_table = std::make_shared<Table>();
+				} else if (m_table.use_count() != 1) {
+					m_table = std::make_shared<Table>(*m_table);
+					m_chunks = m_table->data.data();
+				} else {
+					// The last other owner may have just released the table on another thread,
+					// its reads must happen before it's modified here
+					std::atomic_thread_fence(std::memory_order_acquire);
+				}
+				return *m_table;
+			}
+
+			/**
+			 * @brief Get a chunk for modification, copying it first into an allocation of its
+			 * 		  own, with room for a number of values, unless it has one that nothing
+			 * 		  else holds
+			 * */
+			T* writable_chunk(size_t chunk, size_t room = 0) {
+				Table& table = writable_table();
+				Chunk& held = table.chunks[chunk];
+				const size_t capacity = this->capacity(chunk);
+				if (held.owned && held.holder.get() == table.data[chunk] && held.holder.use_count() == 1 && room <= capacity) {
+					std::atomic_thread_fence(std::memory_order_acquire);
+					return table.data[chunk];
+				}
+
+				const size_t new_capacity = room <= capacity ? capacity : std::min(CHUNK_SIZE, std::max(room, 2 * capacity));
+				std::shared_ptr<T> copy(new T[new_capacity](), std::default_delete<T[]>());
+				std::copy(table.data[chunk], table.data[chunk] + std::min(chunk_size(chunk), new_capacity), copy.get());
+				table.data[chunk] = copy.get();
+				held = Chunk{std::move(copy), true};
+				if (chunk + 1 == table.data.size()) {
+					table.last_capacity = new_capacity;
+				}
+				return table.data[chunk];
+			}
+
+			/**
+			 * @brief Get the chunk the next value goes in for modification, adding it if it's
+			 * 		  not there yet, with room for a number of values
+			 * */
+			T* appendable_chunk(size_t room) {
+				const size_t chunk = m_size / CHUNK_SIZE;
+				if (chunk < chunk_count()) {
+					return writable_chunk(chunk, room);
+				}
+
+				Table& table = writable_table();
+				const size_t capacity = std::min(CHUNK_SIZE, std::max(room, MIN_CAPACITY));
+				std::shared_ptr<T> added(new T[capacity](), std::default_delete<T[]>());
+				table.data.push_back(added.get());
+				table.chunks.push_back(Chunk{std::move(added), true});
+				table.last_capacity = capacity;
+				m_chunks = table.data.data();
+				return table.data.back();
+			}
+
+			// Shared between copies of the array until one of them is written, null while empty
+			std::shared_ptr<Table> m_table;
+
+			// The table's chunks, read without going through m_table
+			T* const* m_chunks = nullptr;
+			size_t m_size = 0;
+	};
+}
@@ -0,0 +1,126 @@
+#include "StringPool.hpp"
+
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+namespace ariel
+{
+	namespace {
+		const size_t MIN_SLOTS = 16;
+
+		std::uint32_t hash_value(std::string_view value) {
+			return static_cast<std::uint32_t>(std::hash<std::string_view>{}(value));
+		}
+	}
+
+	NameId StringPool::intern(std::string_view value) {
+		return intern(value, hash_value(value));
+	}
+
+	NameId StringPool::intern(std::string_view value, std::uint32_t hash) {
+		if (2 * (size() + 1) > m_slots.size()) {
+			grow_slots();
+		}
+
+		size_t slot = find_slot(value, hash);
+		if (m_slots[slot] != NO_NAME) {
+			return m_slots[slot];
+		}
+
+		// The string may start the next chunk, and is followed by its '\0'
+		if (size() >= NO_NAME ||
+			m_bytes.size() + PersistentVector<char>::CHUNK_SIZE + value.size() + 1 > std::numeric_limits<std::uint32_t>::max()) {
+			throw std::length_error("String pool is too large for 32 bit handles");
+		}
+
+		auto name = static_cast<NameId>(size());
+		append_value(value);
+		m_hashes.push_back(hash);
+		m_slots.set(slot, name);
+		return name;
+	}
+
+	void StringPool::append_value(std::string_view value) {
+		m_bytes.append_in_row(value.data(), value.size(), 1);
+		m_offsets.push_back(static_cast<std::uint32_t>(m_bytes.size()));
+	}
+
+	std::uint32_t StringPool::hash(std::string_view value) {
+		return hash_value(value);
+	}
+
+	NameId StringPool::find(std::string_view value) const {
+		if (m_slots.empty()) {
+			return NO_NAME;
+		}
+		return m_slots[find_slot(value, hash_value(value))];
+	}
+
+	StringPool StringPool::copy() const {
+		// The strings are appended again, since a long one has to stay in a row of chunks
+		StringPool copy;
+		copy.m_offsets.reserve(m_offsets.size());
+		for (NameId name = 0; name < size(); ++name) {
+			copy.append_value(value(name));
+		}
+		copy.m_hashes = m_hashes.copy();
+		copy.m_slots = m_slots.copy();
+		return copy;
+	}
+
+	void StringPool::clear() {
+		*this = StringPool();
+	}
+
+	size_t StringPool::memory_usage(bool unshared) const {
+		return sizeof(*this) + m_bytes.memory_usage(unshared) + m_offsets.memory_usage(unshared) +
+			m_hashes.memory_usage(unshared) + m_slots.memory_usage(unshared);
+	}
+
+	size_t StringPool::find_slot(std::string_view value, std::uint32_t hash) const {
+		size_t mask = m_slots.size() - 1;
+		size_t slot = hash & mask;
+		for (; m_slots[slot] != NO_NAME; slot = (slot + 1) & mask) {
+			NameId name = m_slots[slot];
+			if (m_hashes[name] == hash && this->value(name) == value) {
+				break;
+			}
+		}
+		return slot;
+	}
+
+	void StringPool::grow_slots() {
+		fill_slots(m_slots.empty() ? MIN_SLOTS : 2 * m_slots.size());
+	}
+
+	void StringPool::fill_slots(size_t slot_count) {
+		PersistentVector<NameId> slots(slot_count, NO_NAME);
+
+		size_t mask = slot_count - 1;
+		for (NameId name = 0; name < size(); ++name) {
+			size_t slot = m_hashes[name] & mask;
+			while (slots[slot] != NO_NAME) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = name;
+		}
+
+		m_slots = std::move(slots);
+	}
+
+	void StringPool::index_strings() {
+		const size_t count = m_offsets.size() - 1;
+		PersistentVector<std::uint32_t> hashes(count, 0);
+		for (NameId name = 0; name < count; ++name) {
+			hashes[name] = hash_value(value(name));
+		}
+		m_hashes = std::move(hashes);
+
+		size_t slot_count = MIN_SLOTS;
+		while (2 * (count + 1) > slot_count) {
+			slot_count *= 2;
+		}
+		fill_slots(slot_count);
+	}
+}
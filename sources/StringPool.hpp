@@ -0,0 +1,147 @@
+#pragma once
+
+#include "PersistentVector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+	/**
+	 * @brief The handle of a string held by a StringPool
+	 * */
+	using NameId = std::uint32_t;
+
+	/**
+	 * @brief A name handle that doesn't refer to any string
+	 * */
+	constexpr NameId NO_NAME = std::numeric_limits<NameId>::max();
+
+	/**
+	 * @brief An interning string pool. Every distinct string is stored once, all of
+	 * 		  them concatenated in chunks of bytes, and is referred to by a 32 bit handle,
+	 * 		  so two interned strings are equal exactly when their handles are. Every string
+	 * 		  is followed by a '\0', so its value can be passed on as a C string. A string
+	 * 		  that doesn't fit in the rest of a chunk starts the next one, so every string
+	 * 		  stays in a row. Copies of the pool share its chunks until they're modified.
+	 * */
+	class StringPool {
+		public:
+			/**
+			 * @brief Get the handle of a string, adding it to the pool if it's not there yet
+			 * */
+			NameId intern(std::string_view value);
+
+			/**
+			 * @brief Same as intern, with the hash of the string already computed by hash()
+			 * */
+			NameId intern(std::string_view value, std::uint32_t hash);
+
+			/**
+			 * @brief Get the hash the pool files a string under, which can be computed
+			 * 		  ahead of time and on any thread
+			 * */
+			static std::uint32_t hash(std::string_view value);
+
+			/**
+			 * @brief Get the handle of a string without adding it
+			 *
+			 * @return The handle of the string, NO_NAME if it's not in the pool
+			 * */
+			NameId find(std::string_view value) const;
+
+			/**
+			 * @brief Copy the pool into chunks of its own, which no other pool shares
+			 * */
+			StringPool copy() const;
+
+			/**
+			 * @brief Remove all the strings from the pool
+			 * */
+			void clear();
+
+			/**
+			 * @brief Get the number of bytes held by the pool, including unused capacity
+			 *
+			 * @param unshared - Whether to count only what no copy of the pool shares
+			 * */
+			size_t memory_usage(bool unshared = false) const;
+
+			/**
+			 * @brief Get the number of distinct strings in the pool
+			 * */
+			size_t size() const {
+				return m_hashes.size();
+			}
+
+			/**
+			 * @brief Get a string of the pool, which is followed by a '\0' in the pool
+			 * */
+			std::string_view value(NameId name) const {
+				const std::uint32_t end = m_offsets[name + 1];
+				const std::uint32_t begin = value_begin(m_offsets[name], end);
+				return std::string_view(&m_bytes[begin], end - begin - 1);
+			}
+
+			/**
+			 * @brief Get the offset a string starts at, from the end of the one before it and
+			 * 		  its own, after its '\0'. A string that would cross into the next chunk
+			 * 		  starts it instead.
+			 * */
+			static std::uint32_t value_begin(std::uint32_t previous_end, std::uint32_t end) {
+				constexpr auto CHUNK_SIZE = static_cast<std::uint32_t>(PersistentVector<char>::CHUNK_SIZE);
+				if (previous_end == end || previous_end / CHUNK_SIZE == (end - 1) / CHUNK_SIZE) {
+					return previous_end;
+				}
+				return (previous_end + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+			}
+
+		private:
+			// Saves and loads the strings in bulk
+			friend class ChartFile;
+			// Owns the strings along with its nodes
+			friend class FlatTree;
+
+			/**
+			 * @brief Hash all the strings and file them in a new table of slots, once they
+			 * 		  were placed in m_offsets and m_bytes in bulk
+			 * */
+			void index_strings();
+
+			/**
+			 * @brief Append the bytes of a new string, its '\0' and its end offset, without
+			 * 		  filing it
+			 * */
+			void append_value(std::string_view value);
+
+			/**
+			 * @brief Find the slot holding a string, or the empty slot where it belongs
+			 * */
+			size_t find_slot(std::string_view value, std::uint32_t hash) const;
+
+			/**
+			 * @brief Double the number of slots and re-insert all the strings
+			 * */
+			void grow_slots();
+
+			/**
+			 * @brief Re-insert all the strings into a number of slots, a power of two
+			 * */
+			void fill_slots(size_t slot_count);
+
+			// String i ends with its '\0' at m_bytes[m_offsets[i + 1] - 1], and starts at
+			// m_offsets[i] unless it's at the start of the next chunk, see value
+			PersistentVector<std::uint32_t> m_offsets = {0};
+			PersistentVector<char> m_bytes;
+
+			// The hash of every string, so growing the table and rejecting a probe
+			// never has to touch the bytes
+			PersistentVector<std::uint32_t> m_hashes;
+
+			// Open addressing hash table of the handles (linear probing, the number of
+			// slots is a power of two and at most half of them are used)
+			PersistentVector<NameId> m_slots;
+	};
+}